@@ -0,0 +1,103 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NCTE_BENCH_H
+#define NCTE_BENCH_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_REPS 15
+#define BENCH_WARMUP_REPS 3
+
+/* a benchmark function performs iters operations */
+typedef void (*bench_fn)(void *arg, long iters);
+
+struct bench_result {
+	const char *name;
+	long iters;
+	int reps;
+	double min, median, mean, stddev; /* ns per op */
+};
+
+/* written to by benchmarks so the compiler 
+ * cant throw away the work being measured 
+ */
+static volatile long bench_sink;
+
+static inline double bench_now_ns() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec*1e9 + (double) ts.tv_nsec;
+}
+
+static inline int bench_cmp_double(const void *a, const void *b) {
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+static inline void bench_run(const char *name, bench_fn fn, void *arg, long iters, struct bench_result *res) {
+	double samples[BENCH_REPS], start, sum, var;
+	int i;
+
+	for(i = 0; i < BENCH_WARMUP_REPS; i++)
+		(*fn)(arg, iters);
+
+	sum = 0;
+	for(i = 0; i < BENCH_REPS; i++) {
+		start = bench_now_ns();
+		(*fn)(arg, iters);
+		samples[i] = (bench_now_ns() - start)/iters;
+		sum += samples[i];
+	}
+
+	res->name = name;
+	res->iters = iters;
+	res->reps = BENCH_REPS;
+	res->mean = sum/BENCH_REPS;
+
+	var = 0;
+	for(i = 0; i < BENCH_REPS; i++)
+		var += (samples[i] - res->mean)*(samples[i] - res->mean);
+	res->stddev = sqrt(var/(BENCH_REPS - 1));
+
+	qsort(samples, BENCH_REPS, sizeof(double), bench_cmp_double);
+	res->min = samples[0];
+	res->median = samples[BENCH_REPS/2];
+}
+
+static inline void bench_print_header(FILE *human, FILE *csv) {
+	fprintf(human, "%-28s %10s %10s %10s %10s\n", "benchmark", "min ns/op", "median", "mean", "stddev");
+	if(csv != NULL)
+		fprintf(csv, "name,iters,reps,min_ns,median_ns,mean_ns,stddev_ns\n");
+}
+
+static inline void bench_print(FILE *human, FILE *csv, const struct bench_result *res) {
+	fprintf(human, "%-28s %10.2f %10.2f %10.2f %10.2f\n", res->name, res->min, 
+		res->median, res->mean, res->stddev);
+	if(csv != NULL) 
+		fprintf(csv, "%s,%ld,%d,%.3f,%.3f,%.3f,%.3f\n", res->name, res->iters, 
+			res->reps, res->min, res->median, res->mean, res->stddev);
+}
+
+#endif /* NCTE_BENCH_H */
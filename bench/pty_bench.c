@@ -0,0 +1,371 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* drives a real ncte from the outside. ncte runs on a 
+ * pty this program holds the master of, so it plays the
+ * outer terminal, and a scripted shell runs inside ncte.
+ * escape sequences are stripped from what ncte writes so
+ * only the text it draws is matched.
+ *
+ * keystroke_latency: types a key and times how long it
+ * takes for the echo to be drawn. the child is cat with
+ * the pty echoing, so the time is all ncte's.
+ *
+ * throughput_plain, throughput_color: has the child write
+ * BYTES of text (the second with an SGR change every few 
+ * characters) and times until the last line is drawn. 
+ * the results are in ns per byte.
+ *
+ * output is read as fast as ncte writes it, so this 
+ * measures ncte rather than a terminal.
+ *
+ * usage: pty_bench [-o CSVFILE] [-s ROWSxCOLS] [-k KEYS] [-b BYTES] 
+ *                  [-r REPS] NCTE [OPTION ...]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "pty.h"
+#include "err.h"
+#include "bench.h"
+
+#define KEY_GAP_MS 20 /* typing speed, and time for ncte to settle after a key */
+#define SETTLE_MS 300 /* output must be quiet this long before a test starts */
+#define KEY_TIMEOUT_MS 1000
+#define OUTPUT_TIMEOUT_MS 60000
+#define MARKER_MAX 64
+#define MAX_KEYS 100000
+#define MAX_REPS 100
+
+enum strip_state {
+	STRIP_GROUND = 0,
+	STRIP_ESC,
+	STRIP_CSI,
+	STRIP_CHARSET, /* ESC ( and friends take one more byte */
+	STRIP_STRING /* OSC, DCS and so on, until BEL or ST */
+};
+
+static struct {
+	int master;
+	pid_t pid;
+	struct winsize size;
+	int strip;
+	int want_key; /* waiting for this glyph, or -1 */
+	int key_seen;
+	char window[MARKER_MAX]; /* the last glyphs drawn */
+	const char *marker; /* waiting for this text, or NULL */
+	int marker_seen;
+	long bytes; /* read from ncte */
+} h;
+
+/* one byte of text that ncte drew */
+static void glyph(char ch) {
+	size_t len;
+
+	if(h.want_key == (unsigned char) ch)
+		h.key_seen = 1;
+
+	memmove(h.window, h.window + 1, MARKER_MAX - 2);
+	h.window[MARKER_MAX - 2] = ch;
+	h.window[MARKER_MAX - 1] = '\0';
+	if(h.marker != NULL) {
+		len = strlen(h.marker);
+		if(strcmp(h.window + MARKER_MAX - 1 - len, h.marker) == 0)
+			h.marker_seen = 1;
+	}
+}
+
+static void strip(const char *buf, ssize_t n) {
+	unsigned char ch;
+	ssize_t i;
+
+	for(i = 0; i < n; i++) {
+		ch = buf[i];
+		switch(h.strip) {
+		case STRIP_GROUND:
+			if(ch == '\033')
+				h.strip = STRIP_ESC;
+			else if(ch >= ' ' && ch != 0x7f)
+				glyph(ch);
+			break;
+		case STRIP_ESC:
+			if(ch == '[')
+				h.strip = STRIP_CSI;
+			else if(ch == ']' || ch == 'P' || ch == '_' || ch == '^')
+				h.strip = STRIP_STRING;
+			else if(ch >= ' ' && ch <= '/')
+				h.strip = STRIP_CHARSET;
+			else
+				h.strip = STRIP_GROUND;
+			break;
+		case STRIP_CSI:
+			if(ch >= 0x40 && ch <= 0x7e)
+				h.strip = STRIP_GROUND;
+			break;
+		case STRIP_CHARSET:
+			h.strip = STRIP_GROUND;
+			break;
+		case STRIP_STRING:
+			if(ch == '\007')
+				h.strip = STRIP_GROUND;
+			else if(ch == '\033')
+				h.strip = STRIP_ESC; /* the ESC of ST */
+			break;
+		}
+	}
+}
+
+/* read what ncte has written within timeout_ms. 
+ * returns 0 on timeout, 1 if something was read. */
+static int pump(int timeout_ms) {
+	struct pollfd pfd = {.fd = h.master, .events = POLLIN};
+	char buf[8192];
+	ssize_t n;
+	int status;
+
+	if( (status = poll(&pfd, 1, timeout_ms)) < 0) {
+		if(errno == EINTR)
+			return 1;
+		err_exit(errno, "poll");
+	}
+	else if(status == 0)
+		return 0;
+
+	while( (n = read(h.master, buf, sizeof(buf))) > 0) {
+		h.bytes += n;
+		strip(buf, n);
+	}
+
+	if(n == 0 || (n < 0 && errno != EAGAIN) )
+		err_exit(errno, "ncte exited");
+	return 1;
+}
+
+static void settle(int quiet_ms) {
+	while(pump(quiet_ms) != 0)
+		;
+}
+
+/* wait until done is set or timeout_ms passes. returns
+ * the elapsed ns, or -1 on timeout. */
+static double wait_for(const int *done, double start, int timeout_ms) {
+	double now;
+
+	while(!*done) {
+		now = bench_now_ns();
+		if(now - start > timeout_ms*1e6)
+			return -1;
+		pump(timeout_ms - (int) ((now - start)/1e6) );
+	}
+
+	return bench_now_ns() - start;
+}
+
+static void to_ncte(const char *data, size_t len) {
+	if(write(h.master, data, len) != (ssize_t) len)
+		err_exit(errno, "write to ncte");
+}
+
+static void start(char *const ncte_argv[], int ncte_argc, const char *script) {
+	const char *argv[64];
+	int i, k;
+
+	if(ncte_argc + 4 > (int) (sizeof(argv)/sizeof(argv[0])) )
+		err_exit(0, "too many ncte arguments");
+
+	for(i = 0, k = 0; i < ncte_argc; i++)
+		argv[k++] = ncte_argv[i];
+	argv[k++] = "/bin/sh";
+	argv[k++] = "-c";
+	argv[k++] = script;
+	argv[k] = NULL;
+
+	if( (h.pid = pty_spawn(&h.master, NULL, &h.size, "xterm", argv)) < 0)
+		err_exit(errno, "cannot start %s", argv[0]);
+	if(fcntl(h.master, F_SETFL, O_NONBLOCK) != 0)
+		err_exit(errno, "fcntl");
+
+	h.strip = STRIP_GROUND;
+	h.want_key = -1;
+	h.marker = NULL;
+	h.bytes = 0;
+	memset(h.window, ' ', MARKER_MAX - 1);
+	h.window[MARKER_MAX - 1] = '\0';
+	settle(SETTLE_MS);
+}
+
+static void stop() {
+	kill(h.pid, SIGTERM);
+	close(h.master);
+	waitpid(h.pid, NULL, 0);
+}
+
+/* ns samples to the same summary screen_bench gives */
+static void summarize(const char *name, long iters, double *samples, int n, struct bench_result *res) {
+	double sum, var;
+	int i;
+
+	res->name = name;
+	res->iters = iters;
+	res->reps = n;
+	for(i = 0, sum = 0; i < n; i++)
+		sum += samples[i];
+	res->mean = (n > 0)? sum/n : 0;
+	for(i = 0, var = 0; i < n; i++)
+		var += (samples[i] - res->mean)*(samples[i] - res->mean);
+	res->stddev = (n > 1)? sqrt(var/(n - 1)) : 0;
+
+	qsort(samples, n, sizeof(double), bench_cmp_double);
+	res->min = (n > 0)? samples[0] : 0;
+	res->median = (n > 0)? samples[n/2] : 0;
+}
+
+static void bench_keys(char *const ncte_argv[], int ncte_argc, int keys, FILE *csv) {
+	static double samples[MAX_KEYS];
+	struct bench_result res;
+	double elapsed;
+	char ch;
+	int i, n, lost;
+
+	start(ncte_argv, ncte_argc, "stty -icanon; exec cat >/dev/null");
+	for(i = 0, n = 0, lost = 0; i < keys; i++) {
+		ch = 'a' + i%26;
+		h.want_key = (unsigned char) ch;
+		h.key_seen = 0;
+		to_ncte(&ch, 1);
+		if( (elapsed = wait_for(&h.key_seen, bench_now_ns(), KEY_TIMEOUT_MS)) < 0)
+			lost++;
+		else
+			samples[n++] = elapsed;
+
+		h.want_key = -1;
+		settle(KEY_GAP_MS);
+	}
+	stop();
+
+	summarize("keystroke_latency", keys, samples, n, &res);
+	bench_print(stdout, csv, &res);
+	if(n > 0)
+		fprintf(stdout, "  p99 %.0f ns, max %.0f ns", samples[(n*99)/100], samples[n-1]);
+	fprintf(stdout, "%s%d keys never drawn\n", (n > 0)? ", " : "  ", lost);
+}
+
+static void bench_output(char *const ncte_argv[], int ncte_argc, const char *name, 
+		const char *line, long bytes, int reps, FILE *csv) {
+	char script[512], marker[MARKER_MAX];
+	double samples[MAX_REPS], elapsed;
+	struct bench_result res;
+	long drawn;
+	int i, n;
+
+	/* the marker counts the reps, so one from an
+	 * earlier rep being redrawn doesnt match */
+	snprintf(script, sizeof(script), "stty -echo; n=0; while read x; do "
+		"yes \"$(printf '%s')\" | head -c %ld; n=$((n+1)); echo; echo ncte-bench-done-$n.; done", 
+		line, bytes);
+	start(ncte_argv, ncte_argc, script);
+
+	drawn = 0;
+	for(i = 0, n = 0; i < reps; i++) {
+		snprintf(marker, sizeof(marker), "ncte-bench-done-%d.", i + 1);
+		h.marker = marker;
+		h.marker_seen = 0;
+		h.bytes = 0;
+		to_ncte("\n", 1);
+		if( (elapsed = wait_for(&h.marker_seen, bench_now_ns(), OUTPUT_TIMEOUT_MS)) < 0)
+			err_exit(0, "%s: output never finished", name);
+
+		samples[n++] = elapsed/bytes;
+		drawn += h.bytes;
+		settle(KEY_GAP_MS);
+	}
+	h.marker = NULL;
+	stop();
+
+	summarize(name, bytes, samples, n, &res);
+	bench_print(stdout, csv, &res);
+	fprintf(stdout, "  %.1f MB/s in, %ld bytes drawn per rep\n", 1e3/res.median, drawn/reps);
+}
+
+int main(int argc, char *argv[]) {
+	FILE *csv;
+	int c, rows, cols, keys, reps;
+	long bytes;
+
+	csv = NULL;
+	rows = 24;
+	cols = 80;
+	keys = 200;
+	bytes = 4*1024*1024;
+	reps = 5;
+	/* + stops at NCTE so its options are left alone */
+	while( (c = getopt(argc, argv, "+o:s:k:b:r:")) != -1) {
+		switch(c) {
+		case 'o':
+			if( (csv = fopen(optarg, "w")) == NULL)
+				err_exit(errno, "cannot open %s", optarg);
+			break;
+		case 's':
+			if(sscanf(optarg, "%dx%d", &rows, &cols) != 2 || rows < 1 || cols < 1)
+				err_exit(0, "bad screen size: %s", optarg);
+			break;
+		case 'k':
+			if( (keys = atoi(optarg)) < 1 || keys > MAX_KEYS)
+				err_exit(0, "bad key count: %s", optarg);
+			break;
+		case 'b':
+			if( (bytes = atol(optarg)) < 1)
+				err_exit(0, "bad byte count: %s", optarg);
+			break;
+		case 'r':
+			if( (reps = atoi(optarg)) < 1 || reps > MAX_REPS)
+				err_exit(0, "bad rep count: %s", optarg);
+			break;
+		default:
+			optind = argc;
+		}
+	}
+
+	if(optind >= argc) {
+		fprintf(stdout, "usage: %s [-o CSVFILE] [-s ROWSxCOLS] [-k KEYS] [-b BYTES] [-r REPS] "
+			"NCTE [OPTION ...]\n", argv[0]);
+		return 1;
+	}
+
+	h.size.ws_row = rows;
+	h.size.ws_col = cols;
+	signal(SIGPIPE, SIG_IGN);
+
+	bench_print_header(stdout, csv);
+	bench_keys(argv + optind, argc - optind, keys, csv);
+	bench_output(argv + optind, argc - optind, "throughput_plain", 
+		"the quick brown fox jumps over the lazy dog 0123456789", bytes, reps, csv);
+	bench_output(argv + optind, argc - optind, "throughput_color", 
+		"\\033[31mred\\033[32mgreen\\033[1;34mblue\\033[0m plain \\033[7mreverse\\033[0m", 
+		bytes, reps, csv);
+
+	if(csv != NULL)
+		fclose(csv);
+	return 0;
+}
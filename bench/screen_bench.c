@@ -0,0 +1,327 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* microbenchmarks for the conversion functions in screen.c.
+ * screen.c is included directly so its static functions 
+ * can be measured, which means this program is linked 
+ * without screen.o.
+ *
+ * usage: screen_bench [-o CSVFILE] [-s ROWSxCOLS] [NAME ...]
+ */
+
+#include "screen.c"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pty.h"
+#include "bench.h"
+
+#define CELL_SAMPLES 1024
+#define READ_CHUNK (2048*4)
+
+static struct {
+	VTermScreenCell cells[CELL_SAMPLES];
+	VTermColor colors[CELL_SAMPLES];
+	VTermPos positions[CELL_SAMPLES];
+	VTermScreen *vts;
+	int rows, cols;
+	int pipe_fds[2];
+	char chunk[READ_CHUNK];
+	char buf[READ_CHUNK];
+} b;
+
+static void bench_to_curses_attr(void *arg, long iters) {
+	attr_t attr;
+	short pair;
+	long i;
+	(void)(arg);
+
+	for(i = 0; i < iters; i++) {
+		to_curses_attr(&b.cells[i & (CELL_SAMPLES-1)], &attr, &pair);
+		bench_sink += attr + pair;
+	}
+}
+
+static void bench_to_curses_color(void *arg, long iters) {
+	short color, bright;
+	long i;
+	(void)(arg);
+
+	for(i = 0; i < iters; i++) {
+		to_curses_color(vterm_ansi_colors[i & (SCN_TOTAL_ANSI_COLORS-1)], &color, &bright);
+		bench_sink += color + bright;
+	}
+}
+
+static void bench_to_curses_color_miss(void *arg, long iters) {
+	short color, bright;
+	long i;
+	(void)(arg);
+
+	for(i = 0; i < iters; i++) {
+		bench_sink += to_curses_color(b.colors[i & (CELL_SAMPLES-1)], &color, &bright);
+	}
+}
+
+static void bench_to_nearest_curses_color(void *arg, long iters) {
+	short color, bright;
+	long i;
+	(void)(arg);
+
+	for(i = 0; i < iters; i++) {
+		to_nearest_curses_color(b.colors[i & (CELL_SAMPLES-1)], &color, &bright);
+		bench_sink += color + bright;
+	}
+}
+
+static void bench_damage_cell(void *arg, long iters) {
+	VTermRect rect;
+	VTermPos pos;
+	long i;
+	(void)(arg);
+
+	for(i = 0; i < iters; i++) {
+		pos = b.positions[i & (CELL_SAMPLES-1)];
+		rect.start_row = pos.row;
+		rect.end_row = pos.row + 1;
+		rect.start_col = pos.col;
+		rect.end_col = pos.col + 1;
+		screen_damage(rect, NULL);
+		render_commit();
+	}
+}
+
+static void bench_damage_row(void *arg, long iters) {
+	VTermRect rect = {
+		.start_col = 0,
+		.end_col = b.cols
+	};
+	long i;
+	(void)(arg);
+
+	for(i = 0; i < iters; i++) {
+		rect.start_row = i % b.rows;
+		rect.end_row = rect.start_row + 1;
+		screen_damage(rect, NULL);
+		render_commit();
+	}
+}
+
+static void bench_screen_damage(void *arg, long iters) {
+	VTermRect rect = {
+		.start_row = 0,
+		.end_row = b.rows,
+		.start_col = 0,
+		.end_col = b.cols
+	};
+	long i;
+	(void)(arg);
+
+	for(i = 0; i < iters; i++) {
+		screen_damage(rect, NULL);
+		render_commit();
+	}
+}
+
+/* one op is a full chunk pushed through the pty read
+ * path. the pipe write is included in the measurement,
+ * compare with pipe_refill to subtract it out.
+ */
+static void bench_pipe_refill(void *arg, long iters) {
+	long i;
+	(void)(arg);
+
+	for(i = 0; i < iters; i++) {
+		if(write(b.pipe_fds[1], b.chunk, READ_CHUNK) != READ_CHUNK)
+			err_exit(errno, "pipe write");
+		while(read(b.pipe_fds[0], b.buf, READ_CHUNK) > 0)
+			;
+	}
+}
+
+static void bench_process_output(void *arg, long iters) {
+	ssize_t n;
+	long i;
+	int push = (arg != NULL);
+
+	for(i = 0; i < iters; i++) {
+		if(write(b.pipe_fds[1], b.chunk, READ_CHUNK) != READ_CHUNK)
+			err_exit(errno, "pipe write");
+		if( (n = pty_read(b.pipe_fds[0], b.buf, READ_CHUNK)) < 0)
+			err_exit(errno, "pty_read");
+		if(push) {
+			vterm_push_bytes(g_vt, b.buf, n);
+			render_commit();
+		}
+		bench_sink += n;
+	}
+}
+
+static const struct {
+	const char *name;
+	bench_fn fn;
+	void *arg;
+	long iters;
+} benches[] = {
+	{"to_curses_attr", bench_to_curses_attr, NULL, 1000000},
+	{"to_curses_color", bench_to_curses_color, NULL, 1000000},
+	{"to_curses_color_miss", bench_to_curses_color_miss, NULL, 1000000},
+	{"to_nearest_curses_color", bench_to_nearest_curses_color, NULL, 1000000},
+	{"damage_cell", bench_damage_cell, NULL, 100000},
+	{"damage_row", bench_damage_row, NULL, 10000},
+	{"screen_damage_full", bench_screen_damage, NULL, 20},
+	{"pipe_refill", bench_pipe_refill, NULL, 2000},
+	{"pty_read", bench_process_output, NULL, 2000},
+	{"process_output", bench_process_output, (void *) 1, 2000}
+};
+#define NBENCHES ((int) (sizeof(benches)/sizeof(benches[0])))
+
+/* colorful, mostly printable content with SGR 
+ * changes every few characters.
+ */
+static void fill_chunk() {
+	int i, n;
+
+	n = 0;
+	for(i = 0; n < READ_CHUNK - 16; i++) {
+		if(i % 7 == 0)
+			n += snprintf(b.chunk + n, READ_CHUNK - n, "\033[%d;%dm", 30 + i%8, 40 + (i/8)%8);
+		else
+			b.chunk[n++] = 'a' + i%26;
+	}
+	while(n < READ_CHUNK)
+		b.chunk[n++] = '\n';
+}
+
+static void setup(int rows, int cols) {
+	int i;
+	char dims[16];
+	FILE *devnull_out, *devnull_in;
+
+	srand(1);
+	for(i = 0; i < CELL_SAMPLES; i++) {
+		memset(&b.cells[i], 0, sizeof(VTermScreenCell));
+		b.cells[i].chars[0] = 'a' + i%26;
+		b.cells[i].attrs.bold = (i%5 == 0);
+		b.cells[i].attrs.underline = (i%7 == 0);
+		b.cells[i].fg = vterm_ansi_colors[i%SCN_TOTAL_ANSI_COLORS];
+		b.cells[i].bg = (i%3 == 0)? DEFAULT_COLOR : vterm_ansi_colors[(i/3)%SCN_ANSI_COLORS];
+
+		b.colors[i].red = rand() % 256;
+		b.colors[i].green = rand() % 256;
+		b.colors[i].blue = rand() % 256;
+
+		b.positions[i].row = rand() % rows;
+		b.positions[i].col = rand() % cols;
+	}
+
+	snprintf(dims, sizeof(dims), "%d", rows);
+	setenv("LINES", dims, 1);
+	snprintf(dims, sizeof(dims), "%d", cols);
+	setenv("COLUMNS", dims, 1);
+
+	if( (devnull_out = fopen("/dev/null", "w")) == NULL
+			|| (devnull_in = fopen("/dev/null", "r")) == NULL)
+		err_exit(errno, "open /dev/null");
+
+	if(newterm("xterm-256color", devnull_out, devnull_in) == NULL)
+		err_exit(0, "newterm failed");
+	/* /dev/null has no size, so curses guesses */
+	if(resize_term(rows, cols) == ERR)
+		err_exit(0, "resize_term failed");
+	render_alloc(LINES, COLS);
+	if(screen_color_start() != 0)
+		err_exit(0, "screen_color_start failed");
+	
+	screen_set_term(vterm_new(rows, cols));
+	vterm_parser_set_utf8(g_vt, 1);
+	b.vts = vterm_obtain_screen(g_vt);
+	vterm_screen_reset(b.vts, 1);
+
+	fill_chunk();
+	for(i = 0; i < rows*cols/READ_CHUNK + 1; i++)
+		vterm_push_bytes(g_vt, b.chunk, READ_CHUNK);
+
+	b.rows = rows;
+	b.cols = cols;
+
+	if(pipe(b.pipe_fds) != 0)
+		err_exit(errno, "pipe");
+	if(fcntl(b.pipe_fds[0], F_SETFL, O_NONBLOCK) != 0)
+		err_exit(errno, "fcntl");
+}
+
+static int selected(int argc, char *argv[], int first, const char *name) {
+	int i;
+
+	if(first >= argc)
+		return 1;
+
+	for(i = first; i < argc; i++) 
+		if(strcmp(argv[i], name) == 0)
+			return 1;
+
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	struct bench_result res;
+	FILE *csv;
+	int i, c, rows, cols;
+	
+	csv = NULL;
+	rows = 50;
+	cols = 200;
+	while( (c = getopt(argc, argv, "o:s:")) != -1) {
+		switch(c) {
+		case 'o':
+			if( (csv = fopen(optarg, "w")) == NULL)
+				err_exit(errno, "cannot open %s", optarg);
+			break;
+		case 's':
+			if(sscanf(optarg, "%dx%d", &rows, &cols) != 2 || rows < 1 || cols < 1)
+				err_exit(0, "bad screen size: %s", optarg);
+			break;
+		default:
+			fprintf(stdout, "usage: %s [-o CSVFILE] [-s ROWSxCOLS] [NAME ...]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	setup(rows, cols);
+
+	/* curses owns the terminal now, but its output goes
+	 * to /dev/null so stdout is still ours.
+	 */
+	bench_print_header(stdout, csv);
+	for(i = 0; i < NBENCHES; i++) {
+		if(!selected(argc, argv, optind, benches[i].name))
+			continue;
+
+		bench_run(benches[i].name, benches[i].fn, benches[i].arg, benches[i].iters, &res);
+		bench_print(stdout, csv, &res);
+	}
+
+	if(csv != NULL)
+		fclose(csv);
+	vterm_free(g_vt);
+	endwin();
+
+	return 0;
+}
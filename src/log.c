@@ -0,0 +1,114 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "log.h"
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#define LOG_RING_SIZE 1024 /* must be a power of 2 */
+#define LOG_RING_MASK (LOG_RING_SIZE - 1)
+
+struct log_rec {
+	const char *fmt;
+	uint64_t nsec;
+	int args[4];
+	int level;
+};
+
+int log_level = LOG_LVL_NONE;
+
+static struct {
+	struct log_rec ring[LOG_RING_SIZE];
+	uint64_t head, tail; /* head - tail records are pending */
+	uint64_t dropped;
+	uint64_t start;
+} g_log;
+
+static const char *const level_names[] = {
+	"none", "err", "warn", "info", "debug"
+};
+
+static uint64_t log_now() {
+	struct timespec ts;
+
+	if(clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return 0;
+
+	return (uint64_t) ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+/* when the ring is full the oldest record is overwritten */
+void log_push(int level, const char *fmt, int a, int b, int c, int d) {
+	struct log_rec *rec;
+
+	rec = &g_log.ring[g_log.head & LOG_RING_MASK];
+	rec->fmt = fmt;
+	rec->nsec = log_now();
+	rec->args[0] = a;
+	rec->args[1] = b;
+	rec->args[2] = c;
+	rec->args[3] = d;
+	rec->level = level;
+
+	if(g_log.head++ == 0 && g_log.start == 0)
+		g_log.start = rec->nsec;
+
+	if(g_log.head - g_log.tail > LOG_RING_SIZE) {
+		g_log.tail = g_log.head - LOG_RING_SIZE;
+		g_log.dropped++;
+	}
+}
+
+void log_flush(FILE *fp) {
+	struct log_rec *rec;
+	uint64_t rel;
+
+	if(g_log.dropped > 0) {
+		fprintf(fp, "log: dropped %llu records\n", (unsigned long long) g_log.dropped);
+		g_log.dropped = 0;
+	}
+
+	for(; g_log.tail != g_log.head; g_log.tail++) {
+		rec = &g_log.ring[g_log.tail & LOG_RING_MASK];
+		rel = rec->nsec - g_log.start;
+		fprintf(fp, "[%5llu.%06llu] %s: ", (unsigned long long) (rel/1000000000), 
+			(unsigned long long) ((rel/1000)%1000000), level_names[rec->level]);
+		fprintf(fp, rec->fmt, rec->args[0], rec->args[1], rec->args[2], rec->args[3]);
+	}
+
+	fflush(fp);
+}
+
+/* accepts a level name or number. returns -1 if
+ * name is not a valid level.
+ */
+int log_level_parse(const char *name) {
+	int i;
+
+	for(i = 0; i <= LOG_LVL_DEBUG; i++) {
+		if(strcasecmp(name, level_names[i]) == 0)
+			return i;
+	}
+
+	if(name[0] >= '0' && name[0] <= '0' + LOG_LVL_DEBUG && name[1] == '\0')
+		return name[0] - '0';
+
+	return -1;
+}
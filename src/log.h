@@ -0,0 +1,61 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NCTE_LOG_H
+#define NCTE_LOG_H
+
+#include <stdio.h>
+
+enum log_level {
+	LOG_LVL_NONE = 0,
+	LOG_LVL_ERR,
+	LOG_LVL_WARN,
+	LOG_LVL_INFO,
+	LOG_LVL_DEBUG
+};
+
+/* records above this level are compiled out entirely */
+#ifndef NCTE_LOG_LEVEL
+#	define NCTE_LOG_LEVEL LOG_LVL_DEBUG
+#endif
+
+extern int log_level;
+
+/* a record holds the (static) format string and up to 
+ * four int arguments. nothing is formatted until the
+ * ring buffer is flushed, so format strings must 
+ * outlive the record and only use int conversions.
+ */
+void log_push(int level, const char *fmt, int a, int b, int c, int d);
+void log_flush(FILE *fp);
+int log_level_parse(const char *name);
+
+#define LOG_ENABLED(_lvl) ((_lvl) <= NCTE_LOG_LEVEL && (_lvl) <= log_level)
+
+#define LOG_PUSH_(_lvl, _fmt, _a, _b, _c, _d, ...) \
+	do { \
+		if(LOG_ENABLED(_lvl)) \
+			log_push((_lvl), (_fmt), (_a), (_b), (_c), (_d)); \
+	} while(0)
+
+#define LOGF_ERR(...) LOG_PUSH_(LOG_LVL_ERR, __VA_ARGS__, 0, 0, 0, 0)
+#define LOGF_WARN(...) LOG_PUSH_(LOG_LVL_WARN, __VA_ARGS__, 0, 0, 0, 0)
+#define LOGF_INFO(...) LOG_PUSH_(LOG_LVL_INFO, __VA_ARGS__, 0, 0, 0, 0)
+#define LOGF_DEBUG(...) LOG_PUSH_(LOG_LVL_DEBUG, __VA_ARGS__, 0, 0, 0, 0)
+
+#endif /* NCTE_LOG_H */
@@ -0,0 +1,281 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* the main loop: moves child output into vterm, keys
+ * into the child, and decides when to refresh the 
+ * screen.
+ */
+
+#include "loop.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "err.h"
+#include "timer.h"
+#include "metrics.h"
+#include "log.h"
+#include "pty.h"
+#include "outq.h"
+#include "predict.h"
+#include "sync.h"
+#include "trigger.h"
+#include "snapshot.h"
+#include "trace.h"
+
+#define BUF_SIZE 2048*4
+#define ECHO_WINDOW_USEC 100000 /* output this soon after a key is drawn right away */
+
+static struct {
+	const struct loop_io *io;
+	char buf[BUF_SIZE]; /* IO buffer */
+	struct outq queue; /* input waiting to be written to the master pty */
+} g_loop;
+
+int loop_init(size_t queue_size) {
+	return outq_init(&g_loop.queue, queue_size);
+}
+
+void loop_free() {
+	outq_free(&g_loop.queue);
+}
+
+/* move as much of vterm's output buffer into 
+ * the pty queue as will fit.
+ */
+static void queue_vterm_output(VTerm *vt) {
+	size_t buflen, space;
+	char *tail;
+
+	while( (buflen = vterm_output_get_buffer_current(vt) ) > 0 
+			&& (space = outq_tail(&g_loop.queue, &tail) ) > 0) {
+		buflen = (buflen < space)? buflen : space;
+		buflen = vterm_output_bufferread(vt, tail, buflen);
+		outq_commit(&g_loop.queue, buflen);
+	}
+}
+
+/* returns the number of bytes written, which 
+ * is 0 if the master pty isnt ready for more.
+ */
+static ssize_t flush_pty_queue(int master) {
+	ssize_t n_write;
+
+	if( (n_write = outq_flush(&g_loop.queue, master) ) < 0) {
+		/* the child closed the pty, reading from 
+		 * the master will notice and end the loop */
+		if(errno == EIO)
+			return 0;
+
+		err_exit(errno, "error writing to pty master");
+	}
+
+	METRICS_ADD(MTR_PTY_WRITE_BYTES, n_write);
+	TRACE1(pty_write, n_write);
+	return n_write;
+}
+
+/* write pending input to the pty. whatever the pty 
+ * wont take now stays queued until select says the
+ * master is writable again.
+ */
+static void drain_input(VTerm *vt, int master) {
+	do {
+		queue_vterm_output(vt);
+	} while(flush_pty_queue(master) > 0 && vterm_output_get_buffer_current(vt) > 0);
+}
+
+static void process_input(VTerm *vt, int master) {
+	int ch;
+
+	while(vterm_output_get_buffer_remaining(vt) > 0 && g_loop.io->getch(&ch) == 0 ) {
+		TRACE1(key, ch);
+		vterm_input_push_char(vt, VTERM_MOD_NONE, (uint32_t) ch);
+		predict_key(ch);
+	}
+
+	drain_input(vt, master);
+}
+
+static int process_output(VTerm *vt, int master) {
+	ssize_t total_read;
+
+	if( (total_read = g_loop.io->read(master, g_loop.buf, BUF_SIZE)) < 0) {
+		if(errno == EIO)
+			return -1; /* the master pty is closed, return -1 to signify */
+
+		err_exit(errno, "error reading from pty master");
+	}
+
+	METRICS_ADD(MTR_PTY_READ_BYTES, total_read);
+	TRACE1(pty_read, total_read);
+	sync_scan(g_loop.buf, total_read);
+	trigger_scan(g_loop.buf, total_read);
+	TRACE1(push_start, total_read);
+	vterm_push_bytes(vt, g_loop.buf, total_read);
+	TRACE1(push_end, total_read);
+	predict_output();
+	
+	return 0;
+}
+
+/* run until the child closes the pty. all I/O goes
+ * through io, so tests can drive the loop with a fake
+ * child and a virtual clock (see timer_set_clock).
+ */
+void loop(VTerm *vt, const struct loop_io *io) {
+	fd_set in_fds, out_fds;
+	int status, force_refresh, just_refreshed, awaiting_echo, metrics, max_fd;
+	int master = io->master;
+
+	struct timer_t inter_io_timer, refresh_expire, key_timer;
+	struct timeval tv_select;
+	struct timeval *tv_select_p;
+
+	timer_init(&inter_io_timer);
+	timer_init(&refresh_expire);
+	timer_init(&key_timer);
+	/* dont initially need to worry about inter_io_timer's need to timeout */
+	just_refreshed = 1;
+	force_refresh = 0;
+	awaiting_echo = 0;
+	metrics = metrics_fd();
+	max_fd = (metrics > master)? metrics : master;
+	max_fd = (io->input > max_fd)? io->input : max_fd;
+	g_loop.io = io;
+
+	while(1) {
+		FD_ZERO(&in_fds);
+		FD_ZERO(&out_fds);
+		FD_SET(master, &in_fds);
+		/* once the pty queue has backed up into vterm's
+		 * output buffer, stop taking keys until the 
+		 * child catches up.
+		 */
+		if(vterm_output_get_buffer_remaining(vt) > 0)
+			FD_SET(io->input, &in_fds);
+		if(outq_len(&g_loop.queue) > 0)
+			FD_SET(master, &out_fds);
+		if(metrics >= 0)
+			FD_SET(metrics, &in_fds);
+
+		/* if we just refreshed the screen there
+		 * is no need to timeout the select wait. 
+		 * however if we havent refreshed on the last
+		 * iteration we need to make sure that inter_io_timer
+		 * is given a chance to timeout and cause a refresh.
+		 */
+		tv_select.tv_sec = 0;
+		tv_select.tv_usec = 5000;
+		tv_select_p = (just_refreshed == 0)? &tv_select : NULL;
+		/* wake up to save the last changes to the snapshot */
+		if(tv_select_p == NULL && snapshot_dirty() ) {
+			tv_select.tv_sec = 1;
+			tv_select_p = &tv_select;
+		}
+
+		/* about to sleep until there is I/O, so
+		 * this is a good time to format the log. 
+		 */
+		if(tv_select_p == NULL)
+			log_flush(stderr);
+
+		if(io->wait(max_fd + 1, &in_fds, &out_fds, tv_select_p) == -1) {
+			if(errno == EINTR) {
+				metrics_dump_if_requested(stderr);
+				just_refreshed = 0; /* draw whatever a resize damaged */
+				continue;
+			}
+			else
+				err_exit(errno, "select");
+		}
+
+		metrics_dump_if_requested(stderr);
+		if(metrics >= 0 && FD_ISSET(metrics, &in_fds) )
+			metrics_serve();
+
+		if(FD_ISSET(master, &out_fds) )
+			drain_input(vt, master);
+
+		predict_expire();
+
+		if(FD_ISSET(master, &in_fds) ) {
+			if(process_output(vt, master) != 0)
+				return;
+
+			timer_init(&inter_io_timer);
+			/* the child just finished drawing a frame */
+			if(sync_ended() )
+				force_refresh = 1;
+
+			/* the first output after a key is most likely
+			 * its echo, so it skips the burst batching below.
+			 * anything after that is batched as usual.
+			 */
+			if(awaiting_echo != 0) {
+				if( (status = timer_thresh(&key_timer, 0, ECHO_WINDOW_USEC)) == 0)
+					force_refresh = 1;
+				else if(status < 0)
+					err_exit(errno, "timer error");
+
+				awaiting_echo = 0;
+			}
+		}
+
+		/* this is here to make sure really long bursts dont 
+		 * look like frozen I/O. the user should see characters
+		 * whizzing by if there is that much output.
+		 */
+		if( (status = timer_thresh(&refresh_expire, 0, 300000)) ) { 
+			force_refresh = 1; /* must refresh at least 3 times per second */
+		}
+		else if(status < 0)
+			err_exit(errno, "timer error");
+		
+		/* if master pty is 'bursting' with I/O at a quick rate
+		 * we want to let the burst finish (up to a point: see refresh_expire)
+		 * and then refresh the screen, otherwise we waste a bunch of time
+		 * refreshing the screen with stuff that just gets scrolled off
+		 */
+		if(sync_held() )
+			just_refreshed = 0; /* the child is partway through a synchronized update */
+		else if(force_refresh != 0 || (status = timer_thresh(&inter_io_timer, 0, 10000) ) == 1 ) {
+			/* a held back frame is retried once the 
+			 * inter io timer runs out again */
+			just_refreshed = (io->refresh() == 0);
+			timer_init(&inter_io_timer);
+			timer_init(&refresh_expire);
+			force_refresh = 0;
+		}
+		else if(status < 0)
+			err_exit(errno, "timer error");
+		else
+			just_refreshed = 0; /* didnt refresh the screen on this iteration */
+
+		snapshot_tick();
+
+		if(FD_ISSET(io->input, &in_fds) ) {
+			process_input(vt, master);
+
+			timer_init(&key_timer);
+			awaiting_echo = 1;
+			force_refresh = 1; /* draw any predictions */
+		}
+	}
+}
+
@@ -0,0 +1,44 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NCTE_LOOP_H
+#define NCTE_LOOP_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/select.h>
+#include <sys/time.h>
+
+#include "vterm.h"
+
+struct loop_io {
+	int master; /* the child's pty */
+	int input; /* keys arrive here */
+	/* wait for I/O like select. returns -1 with errno
+	 * EINTR to have the screen redrawn soon. */
+	int (*wait)(int nfds, fd_set *in_fds, fd_set *out_fds, struct timeval *timeout);
+	ssize_t (*read)(int fd, char *buf, size_t size); /* like pty_read */
+	int (*getch)(int *ch); /* returns -1 when there are no more keys */
+	int (*refresh)(); /* returns nonzero if the frame was held back */
+};
+
+int loop_init(size_t queue_size);
+void loop_free();
+void loop(VTerm *vt, const struct loop_io *io);
+
+#endif /* NCTE_LOOP_H */
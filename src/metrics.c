@@ -0,0 +1,190 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metrics.h"
+#include "log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define METRICS_BUF_SIZE 4096
+
+uint64_t metrics_counters[MTR_COUNT];
+
+static const struct {
+	const char *name;
+	const char *help;
+} metrics_desc[MTR_COUNT] = {
+	{"ncte_pty_read_bytes_total", "bytes read from the master pty"},
+	{"ncte_pty_write_bytes_total", "bytes written to the master pty"},
+	{"ncte_damage_calls_total", "damage callbacks received from libvterm"},
+	{"ncte_cells_updated_total", "cells converted and written to curses"},
+	{"ncte_refreshes_total", "curses screen refreshes"},
+	{"ncte_resizes_total", "window resize events"},
+	{"ncte_color_cache_misses_total", "nearest color lookups that missed the cache"},
+	{"ncte_frames_held_total", "refreshes held back by --max-bps"}
+};
+
+static struct {
+	int fd;
+	char path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+	dev_t dev; /* identify the socket we bound */
+	ino_t ino;
+	volatile sig_atomic_t dump;
+} g_metrics = {
+	.fd = -1
+};
+
+/* create a unix socket at path. every client that
+ * connects is sent the current counters and then 
+ * disconnected. returns the listening fd or -1 
+ * with errno set.
+ */
+int metrics_listen(const char *path) {
+	struct sockaddr_un addr;
+	struct stat st;
+	int fd, opts;
+
+	if(strlen(path) >= sizeof(addr.sun_path) ) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	/* a stale socket from a previous session would make 
+	 * bind fail, but anything else at path is not ours 
+	 * to remove */
+	if(lstat(path, &st) == 0) {
+		if(!S_ISSOCK(st.st_mode)) {
+			errno = EEXIST;
+			return -1;
+		}
+		if(unlink(path) != 0)
+			return -1;
+	}
+	else if(errno != ENOENT)
+		return -1;
+
+	if( (fd = socket(AF_UNIX, SOCK_STREAM, 0) ) < 0)
+		return -1;
+
+	if(bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0)
+		goto fail;
+	if(lstat(path, &st) != 0)
+		goto fail;
+	if(listen(fd, 4) != 0)
+		goto fail;
+
+	if( (opts = fcntl(fd, F_GETFL)) < 0 || fcntl(fd, F_SETFL, opts | O_NONBLOCK) < 0)
+		goto fail;
+	if(fcntl(fd, F_SETFD, FD_CLOEXEC) < 0)
+		goto fail;
+
+	strcpy(g_metrics.path, path);
+	g_metrics.dev = st.st_dev;
+	g_metrics.ino = st.st_ino;
+	g_metrics.fd = fd;
+	return fd;
+fail:
+	opts = errno;
+	close(fd);
+	errno = opts;
+	return -1;
+}
+
+int metrics_fd() {
+	return g_metrics.fd;
+}
+
+int metrics_format(char *buf, size_t size) {
+	int i, amt, total;
+	pid_t pid = getpid();
+
+	total = 0;
+	for(i = 0; i < MTR_COUNT; i++) {
+		amt = snprintf(buf + total, size - total, 
+			"# HELP %s %s\n# TYPE %s counter\n%s{pid=\"%d\"} %llu\n",
+			metrics_desc[i].name, metrics_desc[i].help, metrics_desc[i].name,
+			metrics_desc[i].name, (int) pid, (unsigned long long) metrics_counters[i]
+		);
+		if(amt < 0 || (size_t) amt >= size - total)
+			return -1;
+		total += amt;
+	}
+
+	return total;
+}
+
+/* called when the listening socket is readable. a 
+ * scraper that doesnt read its response promptly 
+ * just gets a truncated one, we never block on it.
+ */
+void metrics_serve() {
+	char buf[METRICS_BUF_SIZE];
+	int client, len;
+
+	while( (client = accept(g_metrics.fd, NULL, NULL)) >= 0) {
+		if( (len = metrics_format(buf, sizeof(buf))) > 0) {
+			if(send(client, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL) != len)
+				LOGF_WARN("metrics: short write to client\n");
+		}
+		close(client);
+	}
+}
+
+/* safe to call from a signal handler */
+void metrics_request_dump() {
+	g_metrics.dump = 1;
+}
+
+void metrics_dump_if_requested(FILE *fp) {
+	char buf[METRICS_BUF_SIZE];
+	int len;
+
+	if(g_metrics.dump == 0)
+		return;
+	g_metrics.dump = 0;
+
+	if( (len = metrics_format(buf, sizeof(buf))) > 0) {
+		fwrite(buf, sizeof(char), len, fp);
+		fflush(fp);
+	}
+}
+
+void metrics_free() {
+	struct stat st;
+
+	if(g_metrics.fd < 0)
+		return;
+
+	close(g_metrics.fd);
+	/* dont remove whatever may have replaced our socket */
+	if(lstat(g_metrics.path, &st) == 0 && S_ISSOCK(st.st_mode)
+			&& st.st_dev == g_metrics.dev && st.st_ino == g_metrics.ino)
+		unlink(g_metrics.path);
+	g_metrics.fd = -1;
+}
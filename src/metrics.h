@@ -0,0 +1,55 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NCTE_METRICS_H
+#define NCTE_METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+enum metrics_id {
+	MTR_PTY_READ_BYTES = 0,
+	MTR_PTY_WRITE_BYTES,
+	MTR_DAMAGE_CALLS,
+	MTR_CELLS_UPDATED,
+	MTR_REFRESHES,
+	MTR_RESIZES,
+	MTR_COLOR_CACHE_MISSES,
+	MTR_FRAMES_HELD,
+	MTR_COUNT
+};
+
+/* ncte is single threaded, so the counters are plain
+ * integers. the only thing the signal handler touches
+ * is the dump flag, the counters are read from the 
+ * main loop.
+ */
+extern uint64_t metrics_counters[MTR_COUNT];
+
+#define METRICS_ADD(_id, _amt) (metrics_counters[(_id)] += (uint64_t) (_amt))
+#define METRICS_INC(_id) METRICS_ADD(_id, 1)
+
+int metrics_listen(const char *path);
+int metrics_fd();
+void metrics_serve();
+void metrics_request_dump();
+void metrics_dump_if_requested(FILE *fp);
+int metrics_format(char *buf, size_t size);
+void metrics_free();
+
+#endif /* NCTE_METRICS_H */
@@ -27,21 +27,14 @@
 #include <sys/types.h>
 #include <sys/select.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 #include <locale.h>
 #include <signal.h>
 #include <fcntl.h>
 
-#if defined(__FreeBSD__)
-#	include <libutil.h>
-#	include <termios.h>
-#elif defined(__OpenBSD__) || defined(__NetBSD__) || defined(__APPLE__)
-#	include <termios.h>
-#	include <util.h>
-#else
-#	include <pty.h>
-#endif
+#include <termios.h>
 
 #include "vterm.h"
 
@@ -49,18 +42,45 @@
 #include "err.h"
 #include "timer.h"
 #include "opt.h"
-
-#define BUF_SIZE 2048*4
+#include "metrics.h"
+#include "log.h"
+#include "pty.h"
+#include "loop.h"
+#include "predict.h"
+#include "workers.h"
+#include "sync.h"
+#include "trace.h"
+#include "profile.h"
+#include "pool.h"
+#include "trigger.h"
+#include "snapshot.h"
+#include "uring.h"
+
+#define BUF_SIZE 2048*4 /* read size for early output */
+#define PTY_QUEUE_SIZE 1024*64
+#define EARLY_OUTPUT_MAX 1024*1024
 
 /* globals */
 static struct {
 	struct sigaction winch_act, prev_winch_act; /* structs for handing window size change */
+	struct sigaction usr1_act; /* SIGUSR1 dumps metrics to the debug file */
 	int master;		/* master pty */
 	VTerm *vt;		/* libvterm virtual terminal pointer */
-	char buf[BUF_SIZE]; /* IO buffer */
+	struct {
+		char *buf;
+		size_t len, size;
+	} early; /* child output read before vterm was ready for it */
 	struct ncte_conf conf;
+	FILE *profile; /* --profile report, written on exit */
+	struct pool pool; /* all of libvterm's memory */
+	int uring; /* wait and read through io_uring instead of select */
 } g; 
 
+static VTermAllocatorFunctions g_vterm_allocator = {
+	.malloc = pool_alloc,
+	.free = pool_release
+};
+
 static int set_nonblocking(int fd) {
 	int opts;
 
@@ -96,6 +116,13 @@ static inline void unblock_winch() {
 	change_winch(SIG_UNBLOCK);
 }
 
+/* handler for SIGUSR1 */
+static void handler_usr1(int signo) {
+	(void)(signo);
+
+	metrics_request_dump();
+}
+
 /* handler for SIGWINCH */
 static void handler_winch(int signo) {
 	struct winsize size;
@@ -109,159 +136,111 @@ static void handler_winch(int signo) {
 	screen_resize();
 	screen_dims(&size.ws_row, &size.ws_col);
 
-	fprintf(stderr, "resize to %d,%d\n", size.ws_row, size.ws_col);
+	METRICS_INC(MTR_RESIZES);
+	TRACE2(resize, size.ws_row, size.ws_col);
+	LOGF_INFO("resize to %d,%d\n", size.ws_row, size.ws_col);
 	if(ioctl(g.master, TIOCSWINSZ, &size) != 0) 
 		err_exit(errno, "ioctl(TIOCSWINSZ) failed");
 
-	/* this should cause full screen damage and screen will be repainted */
+	/* vterm damages what the resize changed, the rest 
+	 * of the screen was kept by screen_resize */
 	vterm_set_size(g.vt, size.ws_row, size.ws_col);
+	pool_log_stats(&g.pool);
 }
 
-static void write_n_or_exit(int fd, const void *buf, size_t n) {
-	ssize_t n_write, error;
-
-	if( (n_write = write(fd, buf, n) ) != (ssize_t) n) {
-		if(n_write > 0)
-			error = 0;
-		else
-			error = errno;
-		
-		err_exit(error, "partial write");
-	}
-}
+/* most of this process's time is spent waiting for
+ * select's timeout, so we want to handle all
+ * SIGWINCH signals here
+ */
+static int wait_io(int nfds, fd_set *in_fds, fd_set *out_fds, struct timeval *timeout) {
+	int status, saved_errno;
 
-static void process_input(VTerm *vt, int master) {
-	int ch;
-	size_t buflen;
+	unblock_winch(); 
+	if(g.uring)
+		status = uring_wait(nfds, in_fds, out_fds, timeout);
+	else
+		status = select(nfds, in_fds, out_fds, NULL, timeout);
+	saved_errno = errno;
+	block_winch();
 
-	while(vterm_output_get_buffer_remaining(vt) > 0 && screen_getch(&ch) == 0 ) {
-		vterm_input_push_char(vt, VTERM_MOD_NONE, (uint32_t) ch);
-	}
-		
-	while( (buflen = vterm_output_get_buffer_current(vt) ) > 0) {
-		buflen = (buflen < BUF_SIZE)? buflen : BUF_SIZE;
-		buflen = vterm_output_bufferread(vt, g.buf, buflen);
-		write_n_or_exit(master, g.buf, buflen);
-	}
+	errno = saved_errno;
+	return status;
 }
 
-static int process_output(VTerm *vt, int master) {
-	ssize_t n_read, total_read;
+/* the child is started before curses and vterm are
+ * set up, so hold on to what it writes in the meantime
+ * instead of letting it block on a full pty.
+ */
+static void buffer_early_output(int master) {
+	ssize_t n_read;
+	size_t size;
+	char *buf;
 
-	total_read = 0;
 	do {
-		n_read = read(master, g.buf + total_read, 512);
-	} while(n_read > 0 && ( (total_read += n_read) + 512 <= BUF_SIZE) );
-	
-	if(n_read == 0 || (n_read < 0 && errno == EIO) ) { 
-		return -1; /* the master pty is closed, return -1 to signify */
-	}
-	else if(n_read < 0 && errno != EAGAIN) {
-		err_exit(errno, "error reading from pty master (n_read = %d)", n_read);
-	}
-
-	vterm_push_bytes(vt, g.buf, total_read);
-	
-	return 0;
-}
+		if(g.early.size - g.early.len < BUF_SIZE) {
+			if(g.early.size >= EARLY_OUTPUT_MAX)
+				return; /* leave the rest in the pty */
 
-void loop(VTerm *vt, int master) {
-	fd_set in_fds;
-	int status, force_refresh, just_refreshed;
-
-	struct timer_t inter_io_timer, refresh_expire;
-	struct timeval tv_select;
-	struct timeval *tv_select_p;
-
-	timer_init(&inter_io_timer);
-	timer_init(&refresh_expire);
-	/* dont initially need to worry about inter_io_timer's need to timeout */
-	just_refreshed = 1;
-
-	while(1) {
-		FD_ZERO(&in_fds);
-		FD_SET(STDIN_FILENO, &in_fds);
-		FD_SET(master, &in_fds);
-
-		/* if we just refreshed the screen there
-		 * is no need to timeout the select wait. 
-		 * however if we havent refreshed on the last
-		 * iteration we need to make sure that inter_io_timer
-		 * is given a chance to timeout and cause a refresh.
-		 */
-		tv_select.tv_sec = 0;
-		tv_select.tv_usec = 5000;
-		tv_select_p = (just_refreshed == 0)? &tv_select : NULL;
-
-		/* most of this process's time is spent waiting for
-		 * select's timeout, so we want to handle all
-		 * SIGWINCH signals here
-		 */
-		unblock_winch(); 
-		if(select(master + 1, &in_fds, NULL, NULL, tv_select_p) == -1) {
-			if(errno == EINTR) {
-				block_winch();
-				continue;
-			}
-			else
-				err_exit(errno, "select");
+			size = (g.early.size == 0)? BUF_SIZE*2 : g.early.size*2;
+			if( (buf = realloc(g.early.buf, size)) == NULL)
+				return;
+			g.early.buf = buf;
+			g.early.size = size;
 		}
-		block_winch();
 
-		if(FD_ISSET(master, &in_fds) ) {
-			if(process_output(vt, master) != 0)
-				return;
+		/* errors, including the child exiting, are left for loop to find */
+		if( (n_read = pty_read(master, g.early.buf + g.early.len, BUF_SIZE)) <= 0)
+			return;
+		g.early.len += n_read;
+	} while(n_read + PTY_READ_CHUNK > BUF_SIZE);
+}
 
-			timer_init(&inter_io_timer);
-		}
+static void push_early_output(VTerm *vt) {
+	buffer_early_output(g.master);
 
-		/* this is here to make sure really long bursts dont 
-		 * look like frozen I/O. the user should see characters
-		 * whizzing by if there is that much output.
-		 */
-		if( (status = timer_thresh(&refresh_expire, 0, 300000)) ) { 
-			force_refresh = 1; /* must refresh at least 3 times per second */
-		}
-		else if(status < 0)
-			err_exit(errno, "timer error");
-		
-		/* if master pty is 'bursting' with I/O at a quick rate
-		 * we want to let the burst finish (up to a point: see refresh_expire)
-		 * and then refresh the screen, otherwise we waste a bunch of time
-		 * refreshing the screen with stuff that just gets scrolled off
-		 */
-		if(force_refresh != 0 || (status = timer_thresh(&inter_io_timer, 0, 10000) ) == 1 ) {
-			screen_refresh();
-			timer_init(&inter_io_timer);
-			timer_init(&refresh_expire);
-			force_refresh = 0;
-			just_refreshed = 1;
-		}
-		else if(status < 0)
-			err_exit(errno, "timer error");
-		else
-			just_refreshed = 0; /* didnt refresh the screen on this iteration */
+	if(g.early.len > 0) {
+		METRICS_ADD(MTR_PTY_READ_BYTES, g.early.len);
+		sync_scan(g.early.buf, g.early.len);
+		trigger_scan(g.early.buf, g.early.len);
+		vterm_push_bytes(vt, g.early.buf, g.early.len);
+	}
 
-		if(FD_ISSET(STDIN_FILENO, &in_fds) ) {
-			process_input(vt, master);
+	free(g.early.buf);
+	g.early.buf = NULL;
+	g.early.len = g.early.size = 0;
+}
 
-			force_refresh = 1;
-		}
+/* the size of the terminal we are running in, before
+ * curses is started.
+ */
+static void initial_winsize(struct winsize *size) {
+	if(ioctl(STDOUT_FILENO, TIOCGWINSZ, size) != 0 || size->ws_row == 0 || size->ws_col == 0) {
+		size->ws_row = 24;
+		size->ws_col = 80;
 	}
+
+	size->ws_xpixel = size->ws_ypixel = 0;
 }
 
 void err_exit_cleanup(int error) {
 	(void)(error);
 
+	metrics_free();
 	screen_free();
+	log_flush(stderr);
 }
 
 int main(int argc, char *argv[]) {
 	VTermScreen *vts;
 	pid_t child;
 	struct winsize size;
-	const char *debug_file, *env_term;
+	unsigned short rows, cols;
+	const char *debug_file;
+	int predict_mode, render_threads, trigger_action, i, status;
 	struct termios child_termios;
+	struct loop_io io;
+	struct timer_t startup;
+	long t_fork, t_curses, t_vterm, t_color;
 	
 	/* block winch right off the bat
 	 * because we want to defer 
@@ -273,6 +252,10 @@ int main(int argc, char *argv[]) {
 	g.winch_act.sa_handler = handler_winch;
 	sigemptyset(&g.winch_act.sa_mask);
 	g.winch_act.sa_flags = 0;
+
+	g.usr1_act.sa_handler = handler_usr1;
+	sigemptyset(&g.usr1_act.sa_mask);
+	g.usr1_act.sa_flags = 0;
 	
 	opt_init(&g.conf);
 	if(opt_parse(argc, argv, &g.conf) != 0) {
@@ -310,19 +293,110 @@ int main(int argc, char *argv[]) {
 		.sb_popline = NULL
 	};
 
-	if(g.conf.debug_file != NULL)
+	if(g.conf.debug_file != NULL) {
 		debug_file = g.conf.debug_file;
+		log_level = LOG_LVL_DEBUG;
+	}
 	else
 		debug_file = "/dev/null";
+
+	if(g.conf.log_level != NULL && (log_level = log_level_parse(g.conf.log_level)) < 0) {
+		fprintf(stdout, "invalid log level '%s'\n", g.conf.log_level);
+		opt_print_usage(argc, (const char *const *) argv);
+		return 1;
+	}
+
+	if(g.conf.palette != NULL && screen_set_palette(atoi(g.conf.palette)) != 0) {
+		fprintf(stdout, "invalid palette size '%s'\n", g.conf.palette);
+		opt_print_usage(argc, (const char *const *) argv);
+		return 1;
+	}
+
+	predict_mode = PREDICT_NEVER;
+	if(g.conf.predict != NULL && (predict_mode = predict_mode_parse(g.conf.predict)) < 0) {
+		fprintf(stdout, "invalid predict mode '%s'\n", g.conf.predict);
+		opt_print_usage(argc, (const char *const *) argv);
+		return 1;
+	}
+
+	if(g.conf.max_bps != NULL && atol(g.conf.max_bps) <= 0) {
+		fprintf(stdout, "invalid bits per second '%s'\n", g.conf.max_bps);
+		opt_print_usage(argc, (const char *const *) argv);
+		return 1;
+	}
+
+	if(g.conf.io != NULL && strcmp(g.conf.io, "select") != 0 && strcmp(g.conf.io, "uring") != 0) {
+		fprintf(stdout, "invalid io backend '%s'\n", g.conf.io);
+		opt_print_usage(argc, (const char *const *) argv);
+		return 1;
+	}
+
+	trigger_action = TRIGGER_BELL;
+	if(g.conf.trigger_action != NULL 
+			&& (trigger_action = trigger_action_parse(g.conf.trigger_action)) < 0) {
+		fprintf(stdout, "invalid trigger action '%s'\n", g.conf.trigger_action);
+		opt_print_usage(argc, (const char *const *) argv);
+		return 1;
+	}
+
+	for(i = 0; i < g.conf.ntriggers; i++) {
+		if(trigger_add(g.conf.triggers[i]) != 0) {
+			fprintf(stdout, "invalid trigger '%s'\n", g.conf.triggers[i]);
+			return 1;
+		}
+	}
+
+	if(g.conf.trigger_file != NULL && trigger_load(g.conf.trigger_file) != 0) {
+		fprintf(stdout, "failed to load triggers from '%s': %s\n", g.conf.trigger_file, strerror(errno));
+		return 1;
+	}
+
+	if(trigger_build(trigger_action) != 0)
+		err_exit(errno, "failed to build triggers");
+
+	render_threads = 0;
+	if(g.conf.render_threads != NULL) {
+		render_threads = atoi(g.conf.render_threads);
+		if(render_threads < 0 || render_threads > WORKERS_MAX) {
+			fprintf(stdout, "invalid render thread count '%s'\n", g.conf.render_threads);
+			opt_print_usage(argc, (const char *const *) argv);
+			return 1;
+		}
+	}
+
+	/* open the report now so a bad path is caught
+	 * before curses takes over the terminal */
+	if(g.conf.profile_file != NULL) {
+		if( (g.profile = fopen(g.conf.profile_file, "w")) == NULL) {
+			fprintf(stdout, "failed to open profile file '%s'\n", g.conf.profile_file);
+			return 1;
+		}
+		profile_enabled = 1;
+	}
 		
 	if(freopen(debug_file, "w", stderr) == NULL) {
 		err_exit(errno, "redirect stderr");
 	}
 		
 	setlocale(LC_ALL,"");
-	
-	
-	env_term = getenv("TERM"); 
+	timer_init(&startup);
+
+	/* start the child first so it can load while we set up 
+	 * curses and vterm. the environment hasnt been touched 
+	 * yet, so TERM only has to change if --term was given.
+	 */
+	initial_winsize(&size);
+	child = pty_spawn(&g.master, &child_termios, &size, g.conf.term, g.conf.cmd_argv);
+	if(child < 0)
+		err_exit(errno, "cannot start %s", g.conf.cmd_argv[0]);
+
+	if(set_nonblocking(g.master) != 0)
+		err_exit(errno, "failed to set master fd to non-blocking");
+
+	if(loop_init(PTY_QUEUE_SIZE) != 0)
+		err_exit(errno, "failed to allocate pty queue");
+	t_fork = timer_elapsed(&startup);
+
 	/* set the PARENT terminal profile to --ncterm if supplied.
 	 * have to set this before calling screen_init to affect ncurses */
 	if(g.conf.ncterm != NULL)
@@ -333,9 +407,27 @@ int main(int argc, char *argv[]) {
 		err_exit(0, "screen_init failure");
 
 	err_exit_cleanup_fn(err_exit_cleanup);
+	if(g.conf.max_bps != NULL && screen_set_max_bps(atol(g.conf.max_bps)) != 0)
+		err_exit(0, "failed to set up --max-bps");
+	buffer_early_output(g.master);
+	t_curses = timer_elapsed(&startup);
+
+	if(g.conf.metrics_socket != NULL && metrics_listen(g.conf.metrics_socket) < 0)
+		err_exit(errno, "failed to listen on metrics socket %s", g.conf.metrics_socket);
+
+	/* curses may disagree with the tty about the size (e.g. 
+	 * LINES and COLUMNS are set), and curses wins */
+	screen_dims(&rows, &cols);
+	if(rows != size.ws_row || cols != size.ws_col) {
+		size.ws_row = rows;
+		size.ws_col = cols;
+		if(ioctl(g.master, TIOCSWINSZ, &size) != 0) 
+			err_exit(errno, "ioctl(TIOCSWINSZ) failed");
+	}
 
-	screen_dims(&size.ws_row, &size.ws_col);
-	g.vt = vterm_new(size.ws_row, size.ws_col);
+	pool_init(&g.pool);
+	if( (g.vt = vterm_new_with_allocator(size.ws_row, size.ws_col, &g_vterm_allocator, &g.pool)) == NULL)
+		err_exit(errno, "failed to allocate vterm");
 	screen_set_term(g.vt);
 
 	vterm_parser_set_utf8(g.vt, 1);
@@ -346,51 +438,75 @@ int main(int argc, char *argv[]) {
 	vterm_screen_reset(vts, 1);
 
 	vterm_screen_set_callbacks(vts, &screen_cbs, NULL);
+	predict_init(g.vt, predict_mode);
 	/*vterm_screen_set_damage_merge(vts, VTERM_DAMAGE_SCROLL);*/
+	buffer_early_output(g.master);
+	t_vterm = timer_elapsed(&startup);
 
+	status = 0;
 	if(screen_color_start() != 0) {
 		printf("failed to start color\n");
+		/* the child is already running, and hasnt been
+		 * shown to the user, so dont leave it behind */
+		kill(child, SIGKILL);
+		waitpid(child, NULL, 0);
+		status = 1;
 		goto cleanup;
 	}
+	t_color = timer_elapsed(&startup);
 
-	child = forkpty(&g.master, NULL, &child_termios, &size);
-	if(child == 0) {
-		const char *child_term;
-		/* set terminal profile for CHILD to supplied --term arg if exists 
-		 * otherwise make sure to reset the TERM variable to the initial
-		 * environment, even if it was null.
-		 */
-		child_term = NULL;
-		if(g.conf.term != NULL) 
-			child_term = g.conf.term;
-		else if(env_term != NULL) 
-			child_term = env_term;
-			
-		if(child_term != NULL) {
-			if(setenv("TERM", child_term, 1) != 0)
-				err_exit(errno, "error setting environment variable: %s", child_term);
-		}
-		else {
-			if(unsetenv("TERM") != 0)
-				err_exit(errno, "error unsetting environment variable: TERM");
-		}
+	if(render_threads > 0 && screen_render_threads(render_threads) != 0)
+		err_exit(errno, "failed to start %d render threads", render_threads);
 
-		unblock_winch();	
-		execvp(g.conf.cmd_argv[0], (char *const *) g.conf.cmd_argv);
-		err_exit(errno, "cannot exec %s", g.conf.cmd_argv[0]);
-	}
+	/* before the child draws anything over it */
+	if(g.conf.restore_file != NULL && snapshot_restore(g.conf.restore_file, g.vt) != 0)
+		LOGF_WARN("failed to restore the snapshot, errno %d\n", errno);
+	if(g.conf.snapshot_file != NULL && snapshot_open(g.conf.snapshot_file, g.vt) != 0)
+		err_exit(errno, "failed to write snapshot to %s", g.conf.snapshot_file);
 
-	if(set_nonblocking(g.master) != 0)
-		err_exit(errno, "failed to set master fd to non-blocking");
+	push_early_output(g.vt);
+	LOGF_INFO("startup (us): fork %d, curses %d, vterm %d, color %d\n", (int) t_fork, 
+		(int) (t_curses - t_fork), (int) (t_vterm - t_curses), (int) (t_color - t_vterm) );
 	
 	if(sigaction(SIGWINCH, &g.winch_act, &g.prev_winch_act) != 0)
 		err_exit(errno, "sigaction failed");
+
+	if(sigaction(SIGUSR1, &g.usr1_act, NULL) != 0)
+		err_exit(errno, "sigaction failed");
 	
-	loop(g.vt, g.master);
+	io.master = g.master;
+	io.input = STDIN_FILENO;
+	io.wait = wait_io;
+	io.read = pty_read;
+	if(g.conf.io != NULL && strcmp(g.conf.io, "uring") == 0) {
+		if(uring_init(g.master, BUF_SIZE) == 0) {
+			g.uring = 1;
+			io.read = uring_read;
+		}
+		else
+			LOGF_WARN("io_uring unavailable (errno %d), using select\n", errno);
+	}
+	io.getch = screen_getch;
+	io.refresh = screen_refresh;
+	loop(g.vt, &io);
 
 cleanup:
+	uring_free();
+	snapshot_close();
+	if(g.profile != NULL) {
+		profile_report(g.profile);
+		fclose(g.profile);
+	}
+	workers_stop();
+	loop_free();
 	vterm_free(g.vt);
+	pool_log_stats(&g.pool);
+	pool_free(&g.pool);
+	metrics_free();
 	screen_free();
+	log_flush(stderr);
+	trigger_report(stderr);
+	trigger_free();
 
-	return 0;
+	return status;
 }
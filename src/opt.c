@@ -72,8 +72,136 @@ static const struct opt_desc ncte_options[] = {
 		.lopt = {OPT_DEBUG, 1, 0, 'd'}
 	},
 	{
+#define OPT_METRICS_SOCKET "metrics-socket"
+#define OPT_METRICS_SOCKET_INDEX 3
+		.name = OPT_METRICS_SOCKET,
+		.usage = " PATH",
+		.desc = {"serve prometheus style counters on a unix socket at PATH",
+				 "\tcounters are also dumped to the debug file on SIGUSR1", NULL},
+		.default_val = NULL, /* no metrics socket */
+		.lopt = {OPT_METRICS_SOCKET, 1, 0, LONG_ONLY_VAL(OPT_METRICS_SOCKET_INDEX)}
+	},
+	{
+#define OPT_LOG_LEVEL "log-level"
+#define OPT_LOG_LEVEL_INDEX 4
+		.name = OPT_LOG_LEVEL,
+		.usage = " LEVEL",
+		.desc = {"log messages up to LEVEL (none, err, warn, info, debug)",
+				 "\tdefault: debug if --debug is given, otherwise none", NULL},
+		.default_val = NULL, /* depends on whether a debug file was given */
+		.lopt = {OPT_LOG_LEVEL, 1, 0, LONG_ONLY_VAL(OPT_LOG_LEVEL_INDEX)}
+	},
+	{
+#define OPT_PALETTE "palette"
+#define OPT_PALETTE_INDEX 5
+		.name = OPT_PALETTE,
+		.usage = " NCOLORS",
+		.desc = {"map colors outside the ansi palette onto NCOLORS (8 or 16) colors",
+				 "\tdefault: 16", NULL},
+		.default_val = NULL, /* 16 ansi colors */
+		.lopt = {OPT_PALETTE, 1, 0, LONG_ONLY_VAL(OPT_PALETTE_INDEX)}
+	},
+	{
+#define OPT_PREDICT "predict"
+#define OPT_PREDICT_INDEX 6
+		.name = OPT_PREDICT,
+		.usage = " MODE",
+		.desc = {"echo typed characters locally before the child does",
+				 "\tMODE: never, adaptive (when echo is slow) or always", NULL},
+		.default_val = NULL, /* never */
+		.lopt = {OPT_PREDICT, 1, 0, LONG_ONLY_VAL(OPT_PREDICT_INDEX)}
+	},
+	{
+#define OPT_RENDER_THREADS "render-threads"
+#define OPT_RENDER_THREADS_INDEX 7
+		.name = OPT_RENDER_THREADS,
+		.usage = " N",
+		.desc = {"convert damaged cells on N extra threads at refresh time",
+				 "\tdefault: 0, convert damaged cells on the main thread at refresh", NULL},
+		.default_val = NULL, /* no render threads */
+		.lopt = {OPT_RENDER_THREADS, 1, 0, LONG_ONLY_VAL(OPT_RENDER_THREADS_INDEX)}
+	},
+	{
+#define OPT_MAX_BPS "max-bps"
+#define OPT_MAX_BPS_INDEX 8
+		.name = OPT_MAX_BPS,
+		.usage = " BPS",
+		.desc = {"hold back screen updates while the terminal's output queue",
+				 "\tholds more than 100ms of output at BPS bits per second", NULL},
+		.default_val = NULL, /* no limit */
+		.lopt = {OPT_MAX_BPS, 1, 0, LONG_ONLY_VAL(OPT_MAX_BPS_INDEX)}
+	},
+	{
+#define OPT_PROFILE "profile"
+#define OPT_PROFILE_INDEX 9
+		.name = OPT_PROFILE,
+		.usage = " FILENAME",
+		.desc = {"measure damaged, written and changed cells per frame",
+				 "\tand write a report to FILENAME on exit", NULL},
+		.default_val = NULL, /* no profiling */
+		.lopt = {OPT_PROFILE, 1, 0, LONG_ONLY_VAL(OPT_PROFILE_INDEX)}
+	},
+	{
+#define OPT_TRIGGER "trigger"
+#define OPT_TRIGGER_INDEX 10
+		.name = OPT_TRIGGER,
+		.usage = " PATTERN",
+		.desc = {"alert when PATTERN shows up in the output of CMD",
+				 "\tmay be given up to " NCTE_EXPAND_QUOTE(NCTE_TRIGGERS_MAX) " times", NULL},
+		.default_val = NULL, /* no triggers */
+		.lopt = {OPT_TRIGGER, 1, 0, LONG_ONLY_VAL(OPT_TRIGGER_INDEX)}
+	},
+	{
+#define OPT_TRIGGER_FILE "trigger-file"
+#define OPT_TRIGGER_FILE_INDEX 11
+		.name = OPT_TRIGGER_FILE,
+		.usage = " FILENAME",
+		.desc = {"read more trigger patterns from FILENAME, one per line", NULL},
+		.default_val = NULL, /* no trigger file */
+		.lopt = {OPT_TRIGGER_FILE, 1, 0, LONG_ONLY_VAL(OPT_TRIGGER_FILE_INDEX)}
+	},
+	{
+#define OPT_TRIGGER_ACTION "trigger-action"
+#define OPT_TRIGGER_ACTION_INDEX 12
+		.name = OPT_TRIGGER_ACTION,
+		.usage = " ACTION",
+		.desc = {"what a trigger does: bell, flash or log (to the debug file)",
+				 "\tdefault: bell. matches are always logged", NULL},
+		.default_val = NULL, /* bell */
+		.lopt = {OPT_TRIGGER_ACTION, 1, 0, LONG_ONLY_VAL(OPT_TRIGGER_ACTION_INDEX)}
+	},
+	{
+#define OPT_SNAPSHOT "snapshot"
+#define OPT_SNAPSHOT_INDEX 13
+		.name = OPT_SNAPSHOT,
+		.usage = " FILENAME",
+		.desc = {"keep a copy of the screen in FILENAME for --restore",
+				 "\tchanged rows are saved at most once a second", NULL},
+		.default_val = NULL, /* no snapshots */
+		.lopt = {OPT_SNAPSHOT, 1, 0, LONG_ONLY_VAL(OPT_SNAPSHOT_INDEX)}
+	},
+	{
+#define OPT_RESTORE "restore"
+#define OPT_RESTORE_INDEX 14
+		.name = OPT_RESTORE,
+		.usage = " FILENAME",
+		.desc = {"start with the screen saved in FILENAME by --snapshot", NULL},
+		.default_val = NULL, /* start with a blank screen */
+		.lopt = {OPT_RESTORE, 1, 0, LONG_ONLY_VAL(OPT_RESTORE_INDEX)}
+	},
+	{
+#define OPT_IO "io"
+#define OPT_IO_INDEX 15
+		.name = OPT_IO,
+		.usage = " BACKEND",
+		.desc = {"wait for and read child output with select or uring (io_uring)",
+				 "\tdefault: select. uring falls back to select if unavailable", NULL},
+		.default_val = NULL, /* select */
+		.lopt = {OPT_IO, 1, 0, LONG_ONLY_VAL(OPT_IO_INDEX)}
+	},
+	{
 #define OPT_HELP "help"
-#define OPT_HELP_INDEX 3
+#define OPT_HELP_INDEX 16
 		.name = OPT_HELP,
 		.usage = NULL,
 		.desc = {"display this message", NULL},
@@ -81,7 +209,7 @@ static const struct opt_desc ncte_options[] = {
 		.lopt = {OPT_HELP, 0, 0, 'h'}
 	}
 }; /* ncte_options */
-#define NCTE_OPTLEN 4
+#define NCTE_OPTLEN 17
 
 static void init_long_options(struct option *long_options, char *optstring) {
 	int i, os_i;
@@ -123,6 +251,19 @@ void opt_init(struct ncte_conf *conf) {
 	conf->term = DEFAULT_VAL(TERM);
 	conf->ncterm = DEFAULT_VAL(NCTERM);
 	conf->debug_file = DEFAULT_VAL(DEBUG);
+	conf->metrics_socket = DEFAULT_VAL(METRICS_SOCKET);
+	conf->log_level = DEFAULT_VAL(LOG_LEVEL);
+	conf->palette = DEFAULT_VAL(PALETTE);
+	conf->predict = DEFAULT_VAL(PREDICT);
+	conf->render_threads = DEFAULT_VAL(RENDER_THREADS);
+	conf->max_bps = DEFAULT_VAL(MAX_BPS);
+	conf->profile_file = DEFAULT_VAL(PROFILE);
+	conf->ntriggers = 0;
+	conf->trigger_file = DEFAULT_VAL(TRIGGER_FILE);
+	conf->trigger_action = DEFAULT_VAL(TRIGGER_ACTION);
+	conf->snapshot_file = DEFAULT_VAL(SNAPSHOT);
+	conf->restore_file = DEFAULT_VAL(RESTORE);
+	conf->io = DEFAULT_VAL(IO);
 	
 	shell = getenv("SHELL");
 	if(shell != NULL) {
@@ -207,6 +348,63 @@ int opt_parse(int argc, char *const argv[], struct ncte_conf *conf) {
 			conf->ncterm = optarg;
 			break;
 
+		case LONG_ONLY_VAL(OPT_METRICS_SOCKET_INDEX):
+			conf->metrics_socket = optarg;
+			break;
+
+		case LONG_ONLY_VAL(OPT_LOG_LEVEL_INDEX):
+			conf->log_level = optarg;
+			break;
+
+		case LONG_ONLY_VAL(OPT_PALETTE_INDEX):
+			conf->palette = optarg;
+			break;
+
+		case LONG_ONLY_VAL(OPT_PREDICT_INDEX):
+			conf->predict = optarg;
+			break;
+
+		case LONG_ONLY_VAL(OPT_RENDER_THREADS_INDEX):
+			conf->render_threads = optarg;
+			break;
+
+		case LONG_ONLY_VAL(OPT_MAX_BPS_INDEX):
+			conf->max_bps = optarg;
+			break;
+
+		case LONG_ONLY_VAL(OPT_PROFILE_INDEX):
+			conf->profile_file = optarg;
+			break;
+
+		case LONG_ONLY_VAL(OPT_TRIGGER_INDEX):
+			if(conf->ntriggers >= NCTE_TRIGGERS_MAX) {
+				snprintf(opt_err_msg, 64, "more than %d triggers, use --trigger-file", NCTE_TRIGGERS_MAX);
+				errno = OPT_ERR_TOO_MANY;
+				goto fail;
+			}
+			conf->triggers[conf->ntriggers++] = optarg;
+			break;
+
+		case LONG_ONLY_VAL(OPT_TRIGGER_FILE_INDEX):
+			conf->trigger_file = optarg;
+			break;
+
+		case LONG_ONLY_VAL(OPT_TRIGGER_ACTION_INDEX):
+			conf->trigger_action = optarg;
+			break;
+
+		case LONG_ONLY_VAL(OPT_SNAPSHOT_INDEX):
+			conf->snapshot_file = optarg;
+			break;
+
+		case LONG_ONLY_VAL(OPT_RESTORE_INDEX):
+			conf->restore_file = optarg;
+			break;
+
+		case LONG_ONLY_VAL(OPT_IO_INDEX):
+			conf->io = optarg;
+			break;
+
 		case 'h':
 			errno = OPT_ERR_HELP;
 			goto fail;
@@ -19,10 +19,26 @@
 #ifndef NCTE_OPT_H
 #define NCTE_OPT_H
 
+#define NCTE_TRIGGERS_MAX 16 /* --trigger options on the command line */
+
 struct ncte_conf {
 	const char *ncterm;
 	const char *term;
 	const char *debug_file;
+	const char *metrics_socket;
+	const char *log_level;
+	const char *palette;
+	const char *predict;
+	const char *render_threads;
+	const char *max_bps;
+	const char *profile_file;
+	const char *triggers[NCTE_TRIGGERS_MAX];
+	int ntriggers;
+	const char *trigger_file;
+	const char *trigger_action;
+	const char *snapshot_file;
+	const char *restore_file;
+	const char *io;
 	int cmd_argc;
 	const char *const *cmd_argv;
 };
@@ -31,6 +47,7 @@ enum opt_err {
 	OPT_ERR_NONE = 0,
 	OPT_ERR_UNKNOWN_OPTION,
 	OPT_ERR_MISSING_ARG,
+	OPT_ERR_TOO_MANY, /* option given too many times */
 	OPT_ERR_USAGE, /* option requesting usage found */
 	OPT_ERR_HELP /* option requesting help found */
 };
@@ -0,0 +1,107 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "outq.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+
+int outq_init(struct outq *q, size_t size) {
+	if( (q->buf = malloc(size)) == NULL)
+		return -1;
+
+	q->size = size;
+	q->head = 0;
+	q->len = 0;
+	return 0;
+}
+
+void outq_free(struct outq *q) {
+	free(q->buf);
+	q->buf = NULL;
+	q->size = 0;
+	q->len = 0;
+}
+
+size_t outq_len(const struct outq *q) {
+	return q->len;
+}
+
+size_t outq_space(const struct outq *q) {
+	return q->size - q->len;
+}
+
+/* sets ptr to the free region after the newest byte 
+ * and returns how many bytes can be stored there
+ * contiguously. call outq_commit with the amount 
+ * actually stored.
+ */
+size_t outq_tail(struct outq *q, char **ptr) {
+	size_t tail;
+
+	if(q->len == q->size)
+		return 0;
+
+	tail = (q->head + q->len) % q->size;
+	*ptr = q->buf + tail;
+
+	return (tail < q->head)? q->head - tail : q->size - tail;
+}
+
+void outq_commit(struct outq *q, size_t n) {
+	q->len += n;
+}
+
+/* write as much of the queue as fd will take in a 
+ * single writev. returns the number of bytes written
+ * (0 if the write would block) or -1 with errno set.
+ */
+ssize_t outq_flush(struct outq *q, int fd) {
+	struct iovec iov[2];
+	int iovcnt;
+	size_t first;
+	ssize_t n;
+
+	if(q->len == 0)
+		return 0;
+
+	first = q->size - q->head;
+	if(first > q->len)
+		first = q->len;
+
+	iov[0].iov_base = q->buf + q->head;
+	iov[0].iov_len = first;
+	iovcnt = 1;
+	if(first < q->len) {
+		iov[1].iov_base = q->buf;
+		iov[1].iov_len = q->len - first;
+		iovcnt = 2;
+	}
+
+	if( (n = writev(fd, iov, iovcnt)) < 0) {
+		if(errno == EAGAIN || errno == EINTR)
+			return 0;
+		return -1;
+	}
+
+	q->len -= n;
+	/* keep the free space contiguous when possible */
+	q->head = (q->len == 0)? 0 : (q->head + n) % q->size;
+
+	return n;
+}
@@ -0,0 +1,43 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NCTE_OUTQ_H
+#define NCTE_OUTQ_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* a ring buffer of bytes waiting to be written
+ * to a non-blocking fd.
+ */
+struct outq {
+	char *buf;
+	size_t size;
+	size_t head; /* offset of the oldest byte */
+	size_t len; /* bytes queued */
+};
+
+int outq_init(struct outq *q, size_t size);
+void outq_free(struct outq *q);
+size_t outq_len(const struct outq *q);
+size_t outq_space(const struct outq *q);
+size_t outq_tail(struct outq *q, char **ptr);
+void outq_commit(struct outq *q, size_t n);
+ssize_t outq_flush(struct outq *q, int fd);
+
+#endif /* NCTE_OUTQ_H */
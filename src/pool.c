@@ -0,0 +1,157 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "pool.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+#define POOL_MIN_SHIFT 5 /* the smallest block is 32 bytes */
+#define POOL_CHUNK_SIZE (64*1024)
+#define POOL_CHUNK_MAX (POOL_CHUNK_SIZE/8) /* bigger blocks get their own malloc */
+#define POOL_HUGE -1 /* class of blocks too big for any class */
+
+/* precedes every block. blocks from malloc (including 
+ * chunks) have a second header in front that links 
+ * them into pool->system.
+ */
+union pool_header {
+	struct {
+		int cls;
+		size_t size; /* block size including this header */
+	} b;
+	union pool_header *next;
+	long double align; /* keep blocks aligned for any type */
+};
+
+void pool_init(struct pool *p) {
+	memset(p, 0, sizeof(*p));
+}
+
+void pool_free(struct pool *p) {
+	union pool_header *hdr, *next;
+
+	for(hdr = p->system; hdr != NULL; hdr = next) {
+		next = hdr->next;
+		free(hdr);
+	}
+
+	pool_init(p);
+}
+
+static void *system_alloc(struct pool *p, size_t size) {
+	union pool_header *hdr;
+
+	if( (hdr = malloc(sizeof(*hdr) + size)) == NULL)
+		return NULL;
+
+	hdr->next = p->system;
+	p->system = hdr;
+	p->stats.reserved += size;
+	p->stats.system_allocs++;
+	return hdr + 1;
+}
+
+static int size_class(size_t size) {
+	int cls;
+
+	for(cls = 0; cls < POOL_CLASSES; cls++)
+		if(size <= ((size_t) 1 << (cls + POOL_MIN_SHIFT)) )
+			return cls;
+
+	return POOL_HUGE;
+}
+
+/* a fresh block of block_size bytes */
+static union pool_header *new_block(struct pool *p, size_t block_size) {
+	if(block_size > POOL_CHUNK_MAX)
+		return system_alloc(p, block_size);
+
+	/* the rest of the old chunk is lost, but only 
+	 * chunks are ever carved so it is less than 
+	 * POOL_CHUNK_MAX */
+	if(p->chunk_left < block_size) {
+		if( (p->chunk = system_alloc(p, POOL_CHUNK_SIZE)) == NULL)
+			return NULL;
+		p->chunk_left = POOL_CHUNK_SIZE;
+	}
+
+	p->chunk += block_size;
+	p->chunk_left -= block_size;
+	return (union pool_header *) (p->chunk - block_size);
+}
+
+void *pool_alloc(size_t size, void *pool) {
+	struct pool *p = pool;
+	union pool_header *hdr;
+	size_t block_size;
+	int cls;
+
+	block_size = sizeof(*hdr) + size;
+	if( (cls = size_class(block_size)) == POOL_HUGE) {
+		if( (hdr = malloc(block_size)) == NULL)
+			return NULL;
+	}
+	else {
+		block_size = (size_t) 1 << (cls + POOL_MIN_SHIFT);
+		if( (hdr = p->free_list[cls]) != NULL)
+			p->free_list[cls] = hdr->next;
+		else if( (hdr = new_block(p, block_size)) == NULL)
+			return NULL;
+	}
+
+	hdr->b.cls = cls;
+	hdr->b.size = block_size;
+	p->stats.allocs++;
+	p->stats.current += block_size;
+	if(p->stats.current > p->stats.peak)
+		p->stats.peak = p->stats.current;
+
+	memset(hdr + 1, 0, size);
+	return hdr + 1;
+}
+
+void pool_release(void *ptr, void *pool) {
+	struct pool *p = pool;
+	union pool_header *hdr;
+
+	if(ptr == NULL)
+		return;
+
+	hdr = (union pool_header *) ptr - 1;
+	p->stats.frees++;
+	p->stats.current -= hdr->b.size;
+
+	if(hdr->b.cls == POOL_HUGE) {
+		free(hdr);
+		return;
+	}
+
+	/* the header is reused to link the free list */
+	hdr->next = p->free_list[hdr->b.cls];
+	p->free_list[hdr->b.cls] = hdr;
+}
+
+void pool_log_stats(const struct pool *p) {
+	LOGF_INFO("pool: %d KB in use, %d KB peak, %d KB reserved\n", (int) (p->stats.current/1024), 
+		(int) (p->stats.peak/1024), (int) (p->stats.reserved/1024) );
+	LOGF_INFO("pool: %d allocs, %d frees, %d from malloc\n", (int) p->stats.allocs, 
+		(int) p->stats.frees, (int) p->stats.system_allocs);
+}
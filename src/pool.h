@@ -0,0 +1,60 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef NCTE_POOL_H
+#define NCTE_POOL_H
+
+#include <stddef.h>
+
+#define POOL_CLASSES 20 /* block sizes from 32 bytes to 16MB */
+
+union pool_header;
+
+struct pool_stats {
+	size_t current; /* bytes handed out, counted by block size */
+	size_t peak;
+	size_t reserved; /* bytes taken from malloc */
+	unsigned long allocs, frees;
+	unsigned long system_allocs; /* calls to malloc */
+};
+
+/* a size class allocator. requests are rounded up to 
+ * a power of two and freed blocks go back on the free
+ * list of their class instead of back to malloc, so 
+ * a long running session reuses the same memory. 
+ * small blocks are carved out of larger chunks. the 
+ * memory is only returned to malloc by pool_free.
+ */
+struct pool {
+	union pool_header *free_list[POOL_CLASSES];
+	union pool_header *system; /* every block and chunk from malloc */
+	char *chunk; /* unused part of the newest chunk */
+	size_t chunk_left;
+	struct pool_stats stats;
+};
+
+void pool_init(struct pool *p);
+void pool_free(struct pool *p);
+/* the signatures match libvterm's VTermAllocatorFunctions.
+ * memory from pool_alloc is zeroed. */
+void *pool_alloc(size_t size, void *pool);
+void pool_release(void *ptr, void *pool);
+void pool_log_stats(const struct pool *p);
+
+#endif /* NCTE_POOL_H */
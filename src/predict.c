@@ -0,0 +1,294 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* predictive local echo: printable keys are drawn
+ * underlined at the cursor as soon as they are typed
+ * and are confirmed or rolled back once the child's 
+ * echo has been parsed by vterm. predictions are 
+ * always tracked so the echo latency can be measured,
+ * but in adaptive mode they are only drawn while the 
+ * echo is slow.
+ */
+
+#include "predict.h"
+#include <stdint.h>
+#include <strings.h>
+
+#include "screen.h"
+#include "sync.h"
+#include "timer.h"
+#include "log.h"
+
+#define PREDICT_MAX 64
+#define PREDICT_TIMEOUT 1000000 /* usec to wait for an echo */
+#define PREDICT_SLOW_USEC 30000 /* start drawing predictions above this latency */
+#define PREDICT_FAST_USEC 15000 /* stop drawing them below this latency */
+
+struct prediction {
+	VTermPos pos;
+	uint32_t ch;
+	int drawn;
+	struct timer_t timer;
+};
+
+static struct {
+	VTerm *vt;
+	int mode;
+	struct prediction pending[PREDICT_MAX];
+	int npending;
+	int slow; /* the echo latency is high enough to draw predictions */
+	int blocked; /* sent a key we cant predict, wait for the echo to catch up */
+	int glitched; /* the last prediction was wrong */
+	long srtt; /* smoothed echo latency in usec, -1 until measured */
+} g_predict;
+
+static const char *const mode_names[] = {
+	"never", "adaptive", "always"
+};
+
+int predict_mode_parse(const char *name) {
+	int i;
+
+	for(i = 0; i <= PREDICT_ALWAYS; i++) 
+		if(strcasecmp(name, mode_names[i]) == 0)
+			return i;
+
+	return -1;
+}
+
+void predict_init(VTerm *vt, int mode) {
+	g_predict.vt = vt;
+	g_predict.mode = mode;
+	g_predict.npending = 0;
+	g_predict.slow = (mode == PREDICT_ALWAYS);
+	g_predict.blocked = 0;
+	g_predict.glitched = 0;
+	g_predict.srtt = -1;
+}
+
+/* drawing an overlay commits pending damage to stdscr,
+ * which would leak a half drawn synchronized update 
+ * out with the next refresh, e.g. from wgetch. */
+static int should_draw() {
+	return g_predict.slow && !g_predict.glitched && !sync_held();
+}
+
+static void real_cursor(VTermPos *pos) {
+	vterm_state_get_cursorpos(vterm_obtain_state(g_predict.vt), pos);
+}
+
+static void move_cursor(VTermPos pos) {
+	screen_movecursor(pos, pos, 1, NULL);
+}
+
+/* erase predictions from the screen by repainting
+ * the real cells underneath them.
+ */
+static void undraw(int start) {
+	VTermRect rect;
+	VTermPos cursor;
+	int i, any;
+
+	any = 0;
+	for(i = start; i < g_predict.npending; i++) {
+		if(!g_predict.pending[i].drawn)
+			continue;
+
+		rect.start_row = g_predict.pending[i].pos.row;
+		rect.end_row = rect.start_row + 1;
+		rect.start_col = g_predict.pending[i].pos.col;
+		rect.end_col = rect.start_col + 1;
+		screen_damage(rect, NULL);
+		g_predict.pending[i].drawn = 0;
+		any = 1;
+	}
+
+	if(any) {
+		real_cursor(&cursor);
+		move_cursor(cursor);
+	}
+}
+
+static void draw() {
+	struct prediction *p;
+	VTermPos cursor;
+	int i;
+
+	if(g_predict.npending == 0 || !should_draw() )
+		return;
+
+	for(i = 0; i < g_predict.npending; i++) {
+		p = &g_predict.pending[i];
+		screen_draw_overlay(p->pos, p->ch);
+		p->drawn = 1;
+	}
+
+	cursor = g_predict.pending[g_predict.npending-1].pos;
+	cursor.col++;
+	move_cursor(cursor);
+}
+
+static void rollback() {
+	undraw(0);
+	g_predict.npending = 0;
+	g_predict.glitched = 1;
+}
+
+static void sample_latency(long usec) {
+	if(usec < 0)
+		return;
+
+	if(g_predict.srtt < 0)
+		g_predict.srtt = usec;
+	else
+		g_predict.srtt = (7*g_predict.srtt + usec)/8;
+
+	if(g_predict.mode != PREDICT_ADAPTIVE)
+		return;
+
+	if(!g_predict.slow && g_predict.srtt > PREDICT_SLOW_USEC) {
+		LOGF_INFO("predict: echo latency %dus, drawing predictions\n", (int) g_predict.srtt);
+		g_predict.slow = 1;
+	}
+	else if(g_predict.slow && g_predict.srtt < PREDICT_FAST_USEC) {
+		LOGF_INFO("predict: echo latency %dus, not drawing predictions\n", (int) g_predict.srtt);
+		undraw(0);
+		g_predict.slow = 0;
+	}
+}
+
+/* called for every key sent to the child */
+void predict_key(int ch) {
+	struct prediction *p;
+	VTermPos pos;
+	int rows, cols;
+
+	if(g_predict.mode == PREDICT_NEVER)
+		return;
+
+	/* control keys, escape sequences and multibyte 
+	 * characters move the cursor in ways we cant 
+	 * guess, so stop until the child catches up.
+	 */
+	if(ch < 0x20 || ch >= 0x7f) {
+		g_predict.blocked = 1;
+		return;
+	}
+
+	if(g_predict.blocked || g_predict.npending == PREDICT_MAX)
+		return;
+
+	if(g_predict.npending > 0) {
+		pos = g_predict.pending[g_predict.npending-1].pos;
+		pos.col++;
+	}
+	else
+		real_cursor(&pos);
+
+	/* dont try to predict line wrapping */
+	vterm_get_size(g_predict.vt, &rows, &cols);
+	if(pos.col >= cols - 1) {
+		g_predict.blocked = 1;
+		return;
+	}
+
+	p = &g_predict.pending[g_predict.npending++];
+	p->pos = pos;
+	p->ch = (uint32_t) ch;
+	p->drawn = 0;
+	timer_init(&p->timer);
+
+	draw();
+}
+
+/* called after output from the child has been 
+ * pushed into vterm. confirms predictions that 
+ * match the screen and rolls back the rest if 
+ * the echo went somewhere else.
+ */
+void predict_output() {
+	struct prediction *p;
+	VTermScreenCell cell;
+	VTermPos cursor;
+	int confirmed, i;
+
+	if(g_predict.npending == 0) {
+		g_predict.blocked = 0;
+		return;
+	}
+
+	real_cursor(&cursor);
+	for(confirmed = 0; confirmed < g_predict.npending; confirmed++) {
+		p = &g_predict.pending[confirmed];
+		vterm_screen_get_cell(vterm_obtain_screen(g_predict.vt), p->pos, &cell);
+
+		if(cell.chars[0] == p->ch) {
+			sample_latency(timer_elapsed(&p->timer) );
+			g_predict.glitched = 0;
+			continue;
+		}
+
+		/* the cursor passed this cell without echoing
+		 * the prediction, so it and everything after
+		 * it was wrong. */
+		if(cursor.row != p->pos.row || cursor.col > p->pos.col) {
+			LOGF_DEBUG("predict: mispredicted '%c' at %d,%d\n", (int) p->ch, p->pos.row, p->pos.col);
+			undraw(confirmed);
+			g_predict.npending = 0;
+			g_predict.glitched = 1;
+			return;
+		}
+
+		break; /* the echo hasnt arrived yet */
+	}
+
+	for(i = confirmed; i < g_predict.npending; i++)
+		g_predict.pending[i - confirmed] = g_predict.pending[i];
+	g_predict.npending -= confirmed;
+
+	if(g_predict.npending == 0)
+		g_predict.blocked = 0;
+
+	/* damage from the output may have painted over 
+	 * the predictions that are still pending */
+	draw();
+}
+
+/* abandon predictions that were never echoed (e.g.
+ * the child turned off echo for a password).
+ */
+void predict_expire() {
+	if(g_predict.npending == 0)
+		return;
+
+	if(timer_thresh(&g_predict.pending[0].timer, 0, PREDICT_TIMEOUT) == 1) {
+		LOGF_DEBUG("predict: no echo for %d predictions\n", g_predict.npending);
+		rollback();
+		g_predict.blocked = 0;
+	}
+}
+
+/* the number of predictions on the screen */
+int predict_drawn() {
+	int i, n;
+
+	for(i = 0, n = 0; i < g_predict.npending; i++)
+		n += g_predict.pending[i].drawn;
+
+	return n;
+}
@@ -0,0 +1,37 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NCTE_PREDICT_H
+#define NCTE_PREDICT_H
+
+#include "vterm.h"
+
+enum predict_mode {
+	PREDICT_NEVER = 0,
+	PREDICT_ADAPTIVE, /* display predictions only when echo is slow */
+	PREDICT_ALWAYS
+};
+
+int predict_mode_parse(const char *name);
+void predict_init(VTerm *vt, int mode);
+void predict_key(int ch);
+void predict_output();
+void predict_expire();
+int predict_drawn();
+
+#endif /* NCTE_PREDICT_H */
@@ -0,0 +1,121 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* repaint efficiency profile: compares the cells vterm
+ * reports as damaged with the cells that actually 
+ * changed and the cells written to curses, and times 
+ * each stage of a frame. the totals are reported when
+ * ncte exits.
+ */
+
+#include "profile.h"
+#include <time.h>
+
+#include "log.h"
+
+#define PROFILE_BUCKETS 18 /* damage rect sizes up to 2^17 cells and over */
+
+int profile_enabled = 0;
+
+static struct {
+	uint64_t frames;
+	uint64_t rects, damaged, written, changed;
+	uint64_t damage_ns, convert_ns, refresh_ns;
+	uint64_t rect_sizes[PROFILE_BUCKETS]; /* bucket i holds sizes 2^i to 2^(i+1)-1 */
+	struct {
+		int damaged, written, changed;
+	} frame;
+} g_profile;
+
+uint64_t profile_now() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+void profile_damage(int cells, uint64_t ns) {
+	int bucket;
+
+	for(bucket = 0; bucket < PROFILE_BUCKETS - 1 && (cells >> (bucket + 1)) > 0; bucket++)
+		;
+
+	g_profile.rects++;
+	g_profile.rect_sizes[bucket]++;
+	g_profile.frame.damaged += cells;
+	g_profile.damage_ns += ns;
+}
+
+void profile_convert(int written, int changed, uint64_t ns) {
+	g_profile.frame.written += written;
+	g_profile.frame.changed += changed;
+	g_profile.convert_ns += ns;
+}
+
+void profile_frame(uint64_t refresh_ns) {
+	g_profile.frames++;
+	g_profile.refresh_ns += refresh_ns;
+
+	LOGF_DEBUG("profile: frame %d damaged %d, written %d, changed %d\n", (int) g_profile.frames,
+		g_profile.frame.damaged, g_profile.frame.written, g_profile.frame.changed);
+	g_profile.damaged += g_profile.frame.damaged;
+	g_profile.written += g_profile.frame.written;
+	g_profile.changed += g_profile.frame.changed;
+	g_profile.frame.damaged = 0;
+	g_profile.frame.written = 0;
+	g_profile.frame.changed = 0;
+}
+
+static double percent(uint64_t part, uint64_t whole) {
+	return (whole == 0)? 0.0 : 100.0 * part / whole;
+}
+
+static void print_time(FILE *fp, const char *name, uint64_t ns) {
+	double per_frame = (g_profile.frames == 0)? 0.0 : (double) ns / g_profile.frames / 1000.0;
+
+	fprintf(fp, "%-20s %10.3f ms %10.1f us/frame\n", name, ns / 1000000.0, per_frame);
+}
+
+void profile_report(FILE *fp) {
+	int i;
+
+	fprintf(fp, "frames:              %10llu\n", (unsigned long long) g_profile.frames);
+	fprintf(fp, "damage rects:        %10llu\n", (unsigned long long) g_profile.rects);
+	fprintf(fp, "cells damaged:       %10llu\n", (unsigned long long) g_profile.damaged);
+	fprintf(fp, "cells written:       %10llu %6.1f%% of damaged\n", 
+		(unsigned long long) g_profile.written, percent(g_profile.written, g_profile.damaged) );
+	fprintf(fp, "cells changed:       %10llu %6.1f%% of damaged, %.1f%% of written\n", 
+		(unsigned long long) g_profile.changed, percent(g_profile.changed, g_profile.damaged), 
+		percent(g_profile.changed, g_profile.written) );
+
+	print_time(fp, "damage callbacks:", g_profile.damage_ns);
+	print_time(fp, "converting cells:", g_profile.convert_ns);
+	print_time(fp, "curses refresh:", g_profile.refresh_ns);
+
+	fprintf(fp, "damage rect sizes (cells):\n");
+	for(i = 0; i < PROFILE_BUCKETS; i++) {
+		if(g_profile.rect_sizes[i] == 0)
+			continue;
+
+		if(i == PROFILE_BUCKETS - 1)
+			fprintf(fp, "  %7d+       %10llu\n", 1 << i, (unsigned long long) g_profile.rect_sizes[i]);
+		else
+			fprintf(fp, "  %7d-%-7d %10llu\n", 1 << i, (1 << (i + 1)) - 1, 
+				(unsigned long long) g_profile.rect_sizes[i]);
+	}
+}
@@ -0,0 +1,37 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NCTE_PROFILE_H
+#define NCTE_PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* nonzero with --profile. the hooks are only called 
+ * when this is set, so the normal path just pays for
+ * the test.
+ */
+extern int profile_enabled;
+
+uint64_t profile_now();
+void profile_damage(int cells, uint64_t ns);
+void profile_convert(int written, int changed, uint64_t ns);
+void profile_frame(uint64_t refresh_ns);
+void profile_report(FILE *fp);
+
+#endif /* NCTE_PROFILE_H */
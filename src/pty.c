@@ -0,0 +1,226 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#	define _GNU_SOURCE /* for POSIX_SPAWN_SETSID */
+#endif
+
+#include "pty.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* posix_spawn can only give the child a controlling tty
+ * where opening the slave in a new session does that, 
+ * so everywhere else the child is started with forkpty.
+ */
+#if defined(__linux__)
+#	include <spawn.h>
+#endif
+
+#if defined(__linux__) && defined(POSIX_SPAWN_SETSID)
+#	define PTY_USE_SPAWN
+#elif defined(__FreeBSD__)
+#	include <libutil.h>
+#elif defined(__OpenBSD__) || defined(__NetBSD__) || defined(__APPLE__)
+#	include <util.h>
+#else
+#	include <pty.h>
+#endif
+
+#include "err.h"
+
+extern char **environ;
+
+/* read whatever is available on the non-blocking fd
+ * into buf without overflowing size. returns the number
+ * of bytes read, which is 0 if the read would block.
+ * returns -1 with errno set to EIO if the pty has been
+ * closed, or -1 with errno set on any other error.
+ */
+ssize_t pty_read(int fd, char *buf, size_t size) {
+	ssize_t n_read, total_read;
+
+	total_read = 0;
+	do {
+		n_read = read(fd, buf + total_read, PTY_READ_CHUNK);
+	} while(n_read > 0 && ( (size_t) (total_read += n_read) + PTY_READ_CHUNK <= size) );
+
+	if(n_read == 0) {
+		errno = EIO;
+		return -1;
+	}
+	else if(n_read < 0 && errno != EAGAIN) 
+		return -1;
+
+	return total_read;
+}
+
+#ifdef PTY_USE_SPAWN
+
+/* a copy of environ with TERM set to term, or 
+ * environ itself if term is NULL. 
+ */
+static char **child_env(const char *term) {
+	char **env, *term_var;
+	size_t n, i, k;
+
+	if(term == NULL)
+		return environ;
+
+	for(n = 0; environ[n] != NULL; n++)
+		;
+
+	if( (env = malloc( (n + 2)*sizeof(char *) )) == NULL)
+		return NULL;
+	if( (term_var = malloc(strlen("TERM=") + strlen(term) + 1)) == NULL) {
+		free(env);
+		return NULL;
+	}
+	strcpy(term_var, "TERM=");
+	strcat(term_var, term);
+
+	for(i = 0, k = 0; i < n; i++) 
+		if(strncmp(environ[i], "TERM=", 5) != 0)
+			env[k++] = environ[i];
+
+	env[k++] = term_var;
+	env[k] = NULL;
+	return env;
+}
+
+static void free_child_env(char **env) {
+	size_t i;
+
+	if(env == environ)
+		return;
+
+	/* the TERM entry is the only one we allocated */
+	for(i = 0; env[i+1] != NULL; i++)
+		;
+	free(env[i]);
+	free(env);
+}
+
+/* open a pty pair and run argv on the slave side with
+ * posix_spawn, which on linux uses a vfork style clone
+ * and so doesnt copy our address space. the new 
+ * session makes the slave the child's controlling tty 
+ * when it is opened. returns the child pid or -1 with
+ * errno set.
+ */
+pid_t pty_spawn(int *master, const struct termios *termios, const struct winsize *size, 
+		const char *term, const char *const argv[]) {
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	sigset_t mask;
+	char slave_name[64], **env;
+	int mfd, sfd, error;
+	pid_t child;
+
+	env = NULL;
+	sfd = -1;
+	if( (mfd = posix_openpt(O_RDWR | O_NOCTTY)) < 0)
+		return -1;
+	if(fcntl(mfd, F_SETFD, FD_CLOEXEC) != 0 || grantpt(mfd) != 0 || unlockpt(mfd) != 0)
+		goto fail;
+	if( (error = ptsname_r(mfd, slave_name, sizeof(slave_name))) != 0) {
+		errno = error;
+		goto fail;
+	}
+
+	/* set up the slave here so the child starts with the 
+	 * right size and modes */
+	if( (sfd = open(slave_name, O_RDWR | O_NOCTTY | O_CLOEXEC)) < 0)
+		goto fail;
+	if(termios != NULL && tcsetattr(sfd, TCSANOW, termios) != 0)
+		goto fail;
+	if(size != NULL && ioctl(sfd, TIOCSWINSZ, size) != 0)
+		goto fail;
+
+	if( (env = child_env(term)) == NULL) 
+		goto fail;
+
+	if( (error = posix_spawn_file_actions_init(&actions)) != 0) {
+		errno = error;
+		goto fail;
+	}
+	if( (error = posix_spawnattr_init(&attr)) != 0) {
+		posix_spawn_file_actions_destroy(&actions);
+		errno = error;
+		goto fail;
+	}
+
+	sigemptyset(&mask);
+	if( (error = posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, slave_name, O_RDWR, 0)) != 0
+			|| (error = posix_spawn_file_actions_adddup2(&actions, STDIN_FILENO, STDOUT_FILENO)) != 0
+			|| (error = posix_spawn_file_actions_adddup2(&actions, STDIN_FILENO, STDERR_FILENO)) != 0
+			|| (error = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGMASK)) != 0
+			|| (error = posix_spawnattr_setsigmask(&attr, &mask)) != 0) 
+		goto spawn_done;
+
+	error = posix_spawnp(&child, argv[0], &actions, &attr, (char *const *) argv, env);
+
+spawn_done:
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+	if(error != 0) {
+		errno = error;
+		goto fail;
+	}
+
+	free_child_env(env);
+	close(sfd);
+	*master = mfd;
+	return child;
+fail:
+	error = errno;
+	if(env != NULL)
+		free_child_env(env);
+	if(sfd >= 0)
+		close(sfd);
+	close(mfd);
+	errno = error;
+	return -1;
+}
+
+#else /* PTY_USE_SPAWN */
+
+pid_t pty_spawn(int *master, const struct termios *termios, const struct winsize *size, 
+		const char *term, const char *const argv[]) {
+	sigset_t mask;
+	pid_t child;
+
+	child = forkpty(master, NULL, (struct termios *) termios, (struct winsize *) size);
+	if(child == 0) {
+		if(term != NULL && setenv("TERM", term, 1) != 0)
+			err_exit(errno, "error setting environment variable: %s", term);
+
+		sigemptyset(&mask);
+		sigprocmask(SIG_SETMASK, &mask, NULL);
+		execvp(argv[0], (char *const *) argv);
+		err_exit(errno, "cannot exec %s", argv[0]);
+	}
+
+	return child;
+}
+
+#endif /* PTY_USE_SPAWN */
@@ -0,0 +1,32 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NCTE_PTY_H
+#define NCTE_PTY_H
+
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+
+#define PTY_READ_CHUNK 512
+
+ssize_t pty_read(int fd, char *buf, size_t size);
+pid_t pty_spawn(int *master, const struct termios *termios, const struct winsize *size, 
+		const char *term, const char *const argv[]);
+
+#endif /* NCTE_PTY_H */
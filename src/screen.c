@@ -20,6 +20,10 @@
 #include <errno.h>
 #include <stdint.h>
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
 
 #if defined(__APPLE__)
 #	include <ncurses.h>
@@ -28,6 +32,13 @@
 #endif
 
 #include "err.h"
+#include "metrics.h"
+#include "log.h"
+#include "workers.h"
+#include "timer.h"
+#include "trace.h"
+#include "profile.h"
+#include "snapshot.h"
 
 #include "vterm_util.h"
 #include "vterm_ansi_colors.h"
@@ -37,7 +48,98 @@
 #define SCN_REQ_PAIRS SCN_REQ_COLORS*SCN_REQ_COLORS
 #define SCN_TOTAL_ANSI_COLORS (SCN_ANSI_COLORS*2)
 
+/* off-palette colors are quantized to 5 bits per
+ * channel and looked up in a table of nearest ansi
+ * colors. entries are filled in the first time they
+ * are needed and store the ansi index + 1, so 0 means
+ * the entry hasnt been computed yet.
+ */
+#define SCN_LUT_BITS 5
+#define SCN_LUT_SHIFT (8 - SCN_LUT_BITS)
+#define SCN_LUT_SIZE (1 << (SCN_LUT_BITS*3))
+#define SCN_LUT_INDEX(_color) \
+	( ((_color).red >> SCN_LUT_SHIFT) << (SCN_LUT_BITS*2) \
+	| ((_color).green >> SCN_LUT_SHIFT) << SCN_LUT_BITS \
+	| ((_color).blue >> SCN_LUT_SHIFT) )
+
 static VTerm *g_vt;
+static uint8_t g_nearest_lut[SCN_LUT_SIZE];
+static int g_palette_colors = SCN_TOTAL_ANSI_COLORS;
+static unsigned char g_pair_ready[SCN_REQ_PAIRS];
+
+#define SCN_PARALLEL_MIN_CELLS 512 /* smaller frames arent worth waking the workers */
+
+static struct {
+	int threads; /* workers to convert on, 0 to convert on this thread */
+	int rows, cols;
+	cchar_t *stage; /* converted cells, rows*cols */
+	int *dirty_start, *dirty_end; /* dirty span of each row, empty if start >= end */
+	int *dirty_rows; /* rows with a dirty span, in the order they were damaged */
+	int *stage_len; /* cchar_t converted for each dirty row */
+	cchar_t *prev; /* a row read back from stdscr for --profile */
+	int ndirty;
+	int dirty_cells;
+} g_render;
+
+static void render_alloc(int rows, int cols);
+
+/* a copy of stdscr as it was when the child switched
+ * to the alternate screen. vterm damages the whole 
+ * screen when switching back, but the primary screen
+ * cant have changed in the meantime, so the copy is 
+ * put back instead of converting every cell again.
+ * curses then only sends the cells that differ from
+ * the alternate screen. the alternate screen itself
+ * isnt cached since programs erase it when they enter
+ * it anyway.
+ */
+static struct {
+	WINDOW *win;
+	int valid;
+} g_shadow = {
+	.win = NULL,
+	.valid = 0
+};
+
+/* with --max-bps, frames are held back while the outer
+ * tty's output queue is full so keystrokes arent stuck
+ * behind seconds of stale screen updates. a pty (e.g. 
+ * under ssh) always reports an empty queue, so the 
+ * bytes sent are also drained at the configured rate 
+ * to model the queue further down the link.
+ */
+#define SCN_THROTTLE_WINDOW_MS 100 /* let the queue hold this much link time */
+#define SCN_SGR_BYTES 10 /* rough size of an attribute change */
+
+static struct {
+	long budget; /* bytes allowed in the output queue, 0 for no limit */
+	long rate; /* bytes per second */
+	long backlog; /* modeled bytes still on the link */
+	struct timer_t drained; /* last time backlog was drained */
+	WINDOW *input; /* keys are read from here so getch never refreshes */
+} g_throttle = {
+	.budget = 0,
+	.input = NULL
+};
+
+/* stats for the debug log, reset every refresh */
+static struct {
+	int cells;
+	int switches; /* attribute changes between cells */
+} g_frame;
+
+/* the cursor vterm wants, applied once per frame
+ * by commit_cursor instead of on every callback.
+ */
+static struct {
+	VTermPos pos;
+	int visible;
+	int applied_visible; /* last value given to curs_set, -1 if none */
+} g_cursor = {
+	.pos = {0, 0},
+	.visible = 1,
+	.applied_visible = -1
+};
 
 /* just a place holder for the default 
  * ansi color, not actually the color
@@ -64,6 +166,7 @@ int screen_init() {
 	if(nonl() == ERR) 
 		goto fail;
 
+	render_alloc(LINES, COLS);
 	return 0;
 fail:
 	errno = SCN_ERR_INIT;
@@ -86,19 +189,70 @@ void screen_set_term(VTerm *term) {
 	vterm_state_set_default_colors(state, (VTermColor *) &DEFAULT_COLOR, (VTermColor *) &DEFAULT_COLOR);	
 }
 
+/* set the number of ansi colors (8 or 16) that
+ * off-palette colors are mapped onto.
+ */
+int screen_set_palette(int colors) {
+	if(colors != SCN_ANSI_COLORS && colors != SCN_TOTAL_ANSI_COLORS) {
+		errno = SCN_ERR_PALETTE;
+		return -1;
+	}
+
+	g_palette_colors = colors;
+	memset(g_nearest_lut, 0, sizeof(g_nearest_lut));
+	return 0;
+}
+
 void screen_dims(unsigned short *rows, unsigned short *cols) {
 	getmaxyx(stdscr, *rows, *cols);
 }
 
+static inline int contained(int y, int x) {
+	int maxx, maxy;
+
+	getmaxyx(stdscr, maxy, maxx);	
+	return (x < maxx) && (y < maxy);
+}
+
+static void commit_cursor() {
+	if(g_cursor.visible != g_cursor.applied_visible) {
+		/* will return ERR if cursor not supported, *
+		 * so we dont bother checking return value  */
+		curs_set(g_cursor.visible);
+		g_cursor.applied_visible = g_cursor.visible;
+	}
+
+	/* sometimes this happens when
+	 * a window resize recently happened
+	 */
+	if(!contained(g_cursor.pos.row, g_cursor.pos.col) ) {
+		LOGF_WARN("tried to move cursor out of bounds to %d/%d %d/%d\n", g_cursor.pos.row, LINES-1, g_cursor.pos.col, COLS-1);
+		return;
+	}
+
+	if(move(g_cursor.pos.row, g_cursor.pos.col) == ERR)
+		err_exit(0, "move failed: %d/%d %d/%d", g_cursor.pos.row, LINES-1, g_cursor.pos.col, COLS-1);
+}
+
 int screen_getch(int *ch) {
-	*ch = getch();
+	WINDOW *win = stdscr;
+
+	/* wgetch doesnt refresh pads */
+	if(g_throttle.input != NULL)
+		win = g_throttle.input;
+	/* getch refreshes stdscr if it has been modified,
+	 * so the cursor needs to be where vterm wants it */
+	else if(is_wintouched(stdscr) )
+		commit_cursor();
+
+	*ch = wgetch(win);
 
 	/* resize will be handled by signal
 	 * so flush out all the resize keys
 	 */
 	if(*ch == KEY_RESIZE) 
 		while(*ch == KEY_RESIZE) {
-			*ch = getch();
+			*ch = wgetch(win);
 		}
 
 	if(*ch == ERR) 
@@ -124,9 +278,6 @@ int screen_getch(int *ch) {
 } */
 
 int screen_color_start() {
-	int i,k;
-	short pair, fg, bg;
-
 	if(has_colors() == ERR) {
 		errno = SCN_ERR_COLOR_NOT_SUPPORTED;
 		goto fail;
@@ -151,36 +302,36 @@ int screen_color_start() {
 	if(COLOR_PAIRS < SCN_REQ_PAIRS) {
 		/*errno = SCN_ERR_COLOR_PAIRS;
 		goto fail;*/
-		fprintf(stderr, "warning: your terminal may not support 81 color pairs. if problems arise, try setting TERM to 'xterm-256color'\n");
-	}
-
-	for(i = 0; i < SCN_REQ_COLORS; i++) {
-		for(k = 0; k < SCN_REQ_COLORS; k++) {
-			pair = i*SCN_REQ_COLORS + k;
-			if(pair == 0) { /* pair 0 already set to default fg on default bg */
-				continue;
-			}
-			
-			fg = ((SCN_REQ_COLORS - 1)-i > (SCN_ANSI_COLORS - 1))? -1 : (SCN_REQ_COLORS - 1)-i; /* => pair 0 = -1,-1 */
-			bg = ((SCN_REQ_COLORS - 1)-k > (SCN_ANSI_COLORS - 1))? -1 : (SCN_REQ_COLORS - 1)-k;
-
-			if(init_pair(pair, fg, bg) == ERR) {
-				errno = SCN_ERR_COLOR_PAIR_INIT;
-				goto fail;
-			}
-		}
+		LOGF_WARN("your terminal may not support 81 color pairs. if problems arise, try setting TERM to 'xterm-256color'\n");
 	}
+
+	/* pair 0 is already set to default fg on default bg,
+	 * the rest are initialized by init_pair_once the 
+	 * first time they are drawn.
+	 */
+	memset(g_pair_ready, 0, sizeof(g_pair_ready));
+	g_pair_ready[0] = 1;
 	
 	return 0;
 fail:
 	return -1;
 }
 
-static inline int contained(int y, int x) {
-	int maxx, maxy;
+static void init_pair_once(short pair) {
+	int i, k;
+	short fg, bg;
 
-	getmaxyx(stdscr, maxy, maxx);	
-	return (x < maxx) && (y < maxy);
+	if(g_pair_ready[pair])
+		return;
+	g_pair_ready[pair] = 1;
+
+	i = pair/SCN_REQ_COLORS;
+	k = pair%SCN_REQ_COLORS;
+	fg = ((SCN_REQ_COLORS - 1)-i > (SCN_ANSI_COLORS - 1))? -1 : (SCN_REQ_COLORS - 1)-i; /* => pair 0 = -1,-1 */
+	bg = ((SCN_REQ_COLORS - 1)-k > (SCN_ANSI_COLORS - 1))? -1 : (SCN_REQ_COLORS - 1)-k;
+
+	if(init_pair(pair, fg, bg) == ERR) 
+		LOGF_WARN("init_pair(%d, %d, %d) failed\n", pair, fg, bg);
 }
 
 static void color_index_to_curses_color_index(int index, short *curs_color, short *bright) {
@@ -245,38 +396,55 @@ fail:
 	return -1;	
 }
 
-/* smallest dist^2 determines nearest
- * ansi color
+/* smallest perceptual distance determines nearest
+ * ansi color. the color is measured from the center
+ * of its quantization bucket so every color in the
+ * bucket maps to the same entry.
  */
-static void to_nearest_curses_color(VTermColor color, short *curs_color, short *bright) {
-	int i, min_index, min_dist_sq, dist_sq;
+static int nearest_ansi_index(VTermColor color) {
+	int i, min_index, min_dist, dist;
+	const int half = (1 << SCN_LUT_SHIFT)/2;
 
-	min_dist_sq = vterm_color_dist_sq(&color, &vterm_ansi_colors[0]);
+	color.red = (color.red & ~((1 << SCN_LUT_SHIFT) - 1)) + half;
+	color.green = (color.green & ~((1 << SCN_LUT_SHIFT) - 1)) + half;
+	color.blue = (color.blue & ~((1 << SCN_LUT_SHIFT) - 1)) + half;
+
+	min_dist = vterm_color_dist_perceptual(&color, &vterm_ansi_colors[0]);
 	min_index = 0;
-	for(i = 1; i < SCN_TOTAL_ANSI_COLORS; i++) {
-		dist_sq = vterm_color_dist_sq(&color, &vterm_ansi_colors[i]);
-		if(dist_sq <= min_dist_sq) {
-			min_dist_sq = dist_sq;
+	for(i = 1; i < g_palette_colors; i++) {
+		dist = vterm_color_dist_perceptual(&color, &vterm_ansi_colors[i]);
+		if(dist <= min_dist) {
+			min_dist = dist;
 			min_index = i;
 		}
 	}
 
-	color_index_to_curses_color_index(min_index, curs_color, bright);
+	return min_index;
+}
+
+static void to_nearest_curses_color(VTermColor color, short *curs_color, short *bright) {
+	uint8_t *entry;
+
+	entry = &g_nearest_lut[SCN_LUT_INDEX(color)];
+	if(*entry == 0) {
+		METRICS_INC(MTR_COLOR_CACHE_MISSES);
+		*entry = nearest_ansi_index(color) + 1;
+		LOGF_DEBUG("to_nearest_curses_color: mapped color %d,%d,%d to ansi color %d\n", color.red, color.green, color.blue, *entry - 1);
+	}
+
+	color_index_to_curses_color_index(*entry - 1, curs_color, bright);
 }
 
 static void to_curses_pair(VTermColor fg, VTermColor bg, attr_t *attr, short *pair) {
 	short curs_fg, curs_bg, bright_fg, bright_bg;
 	
-	if(to_curses_color(fg, &curs_fg, &bright_fg) != 0) {
+	if(to_curses_color(fg, &curs_fg, &bright_fg) != 0) 
 		to_nearest_curses_color(fg, &curs_fg, &bright_fg);
-		fprintf(stderr, "to_curses_pair: mapped fg color %d,%d,%d to color %d\n", fg.red, fg.green, fg.blue, curs_fg);
-	}
-	if(to_curses_color(bg, &curs_bg, &bright_bg) != 0) {
+	if(to_curses_color(bg, &curs_bg, &bright_bg) != 0) 
 		to_nearest_curses_color(bg, &curs_bg, &bright_bg);
-		fprintf(stderr, "to_curses_pair: mapped bg color %d,%d,%d to color %d\n", bg.red, bg.green, bg.blue, curs_bg);
-	}
 	
 	*pair = SCN_REQ_COLORS*curs_fg + curs_bg;
+	init_pair_once(*pair);
 
 	if(bright_fg)
 		*attr |= A_BOLD;
@@ -301,45 +469,277 @@ static void to_curses_attr(const VTermScreenCell *cell, attr_t *attr, short *pai
 	*attr = result;
 }
 
-static void update_cell(VTermScreen *vts, VTermPos pos) {
-	VTermScreenCell cell;
+/* attributes that still show on a blank cell */
+#define SCN_BLANK_VISIBLE (A_UNDERLINE | A_REVERSE)
+
+/* the attributes of the previous cell in a span */
+struct attr_run {
 	attr_t attr;
 	short pair;
-	cchar_t cch;
-	wchar_t *wch;
-	wchar_t erasech = L' ';
-	int maxx, maxy;
+	int len;
+};
 
-	getmaxyx(stdscr, maxy, maxx);
+/* curses emits an SGR sequence whenever the attributes
+ * change from one cell to the next. the foreground and
+ * bold/blink of a blank cell cant be seen, so a blank 
+ * takes those from the cell before it and only keeps 
+ * its own background. that way a colored word followed
+ * by spaces stays one run.
+ */
+static void convert_cell(const VTermScreenCell *cell, struct attr_run *run, cchar_t *cch) {
+	attr_t attr;
+	short pair;
+	const wchar_t *wch;
+	static const wchar_t erasech = L' ';
+	int blank;
+
+	to_curses_attr(cell, &attr, &pair);
+
+	blank = (cell->chars[0] == 0 || cell->chars[0] == ' ');
+	if(blank && run->len > 0 && !(attr & SCN_BLANK_VISIBLE) 
+			&& !(run->attr & SCN_BLANK_VISIBLE) ) {
+		attr = run->attr;
+		pair = SCN_REQ_COLORS*(run->pair/SCN_REQ_COLORS) + pair%SCN_REQ_COLORS;
+		init_pair_once(pair);
+	}
+
+	if(run->len == 0 || attr != run->attr || pair != run->pair) {
+		run->attr = attr;
+		run->pair = pair;
+		run->len = 0;
+	}
+	run->len++;
+
+	wch = (cell->chars[0] == 0)? &erasech : (const wchar_t *) &cell->chars[0];
+	if(setcchar(cch, wch, attr, pair, NULL) == ERR)
+		err_exit(0, "setcchar failed");
+}
+
+/* libvterm marks the right half of a wide character 
+ * with this value in chars[0] */
+#define SCN_WIDE_CONTINUATION ((uint32_t) -1)
+
+/* convert the cells of row from *start up to end into 
+ * cch. curses fills in the right half of wide characters
+ * itself, so their continuation cells are skipped. if 
+ * *start is a continuation cell it is moved back to the 
+ * wide character. returns the number of cchar_t written.
+ */
+static int convert_span(VTermScreen *vts, int row, int *start, int end, cchar_t *cch) {
+	VTermScreenCell cell;
+	VTermPos pos;
+	struct attr_run run = {.len = 0};
+	int n, switches;
+
+	pos.row = row;
+	pos.col = *start;
+	vterm_screen_get_cell(vts, pos, &cell);
+	if(cell.chars[0] == SCN_WIDE_CONTINUATION && pos.col > 0) {
+		pos.col--;
+		vterm_screen_get_cell(vts, pos, &cell);
+		*start = pos.col;
+	}
+
+	for(n = 0, switches = 0; pos.col < end; n++) {
+		convert_cell(&cell, &run, &cch[n]);
+		if(run.len == 1)
+			switches++;
+		pos.col += (cell.width > 1)? cell.width : 1;
+		if(pos.col < end)
+			vterm_screen_get_cell(vts, pos, &cell);
+	}
+
+	/* may be running on a worker thread */
+	__sync_fetch_and_add(&g_frame.switches, switches);
+	return n;
+}
+
+/* damage only marks cells dirty. at refresh the dirty
+ * rows are converted into the staging buffer (by the 
+ * worker pool if there is one) and then written to 
+ * curses from this thread, since curses isnt thread
+ * safe. deferring the conversion also means damage 
+ * that is overwritten before the next refresh is only
+ * converted once.
+ */
+static void render_alloc(int rows, int cols) {
+	int i;
+
+	free(g_render.stage);
+	free(g_render.dirty_start);
+	free(g_render.dirty_end);
+	free(g_render.dirty_rows);
+	free(g_render.stage_len);
+	free(g_render.prev);
+
+	g_render.stage = malloc(sizeof(cchar_t)*rows*cols);
+	g_render.dirty_start = malloc(sizeof(int)*rows);
+	g_render.dirty_end = malloc(sizeof(int)*rows);
+	g_render.dirty_rows = malloc(sizeof(int)*rows);
+	g_render.stage_len = malloc(sizeof(int)*rows);
+	g_render.prev = malloc(sizeof(cchar_t)*(cols + 1));
+	if(g_render.stage == NULL || g_render.dirty_start == NULL || g_render.dirty_end == NULL 
+			|| g_render.dirty_rows == NULL || g_render.stage_len == NULL
+			|| g_render.prev == NULL)
+		err_exit(errno, "failed to allocate render buffers");
+
+	for(i = 0; i < rows; i++)
+		g_render.dirty_start[i] = g_render.dirty_end[i] = 0;
+
+	g_render.rows = rows;
+	g_render.cols = cols;
+	g_render.ndirty = 0;
+	g_render.dirty_cells = 0;
+}
+
+static void render_mark(VTermRect rect) {
+	int row, start, end;
 
 	/* sometimes this happens when
 	 * a window resize recently happened
 	 */
-	if(!contained(pos.row, pos.col) ) {
-		fprintf(stderr, "tried to update out of bounds cell at %d/%d %d/%d\n", pos.row, maxy-1, pos.col, maxx-1);
+	if(rect.end_row > g_render.rows || rect.end_col > g_render.cols) 
+		LOGF_WARN("damage rows %d-%d cols %d-%d out of bounds\n", rect.start_row, rect.end_row, rect.start_col, rect.end_col);
+
+	start = rect.start_col;
+	end = (rect.end_col < g_render.cols)? rect.end_col : g_render.cols;
+	if(start >= end)
 		return;
+
+	for(row = rect.start_row; row < rect.end_row && row < g_render.rows; row++) {
+		if(g_render.dirty_start[row] >= g_render.dirty_end[row]) {
+			g_render.dirty_rows[g_render.ndirty++] = row;
+			g_render.dirty_start[row] = start;
+			g_render.dirty_end[row] = end;
+			g_render.dirty_cells += end - start;
+			continue;
+		}
+
+		if(start < g_render.dirty_start[row]) {
+			g_render.dirty_cells += g_render.dirty_start[row] - start;
+			g_render.dirty_start[row] = start;
+		}
+		if(end > g_render.dirty_end[row]) {
+			g_render.dirty_cells += end - g_render.dirty_end[row];
+			g_render.dirty_end[row] = end;
+		}
 	}
+}
 
-	vterm_screen_get_cell(vts, pos, &cell);	
-	to_curses_attr(&cell, &attr, &pair);
+/* forget all pending damage */
+static void render_reset() {
+	int i, row;
 
-	wch = (cell.chars[0] == 0)? &erasech : (wchar_t *) &cell.chars[0];
-	if(setcchar(&cch, wch, attr, pair, NULL) == ERR)
-		err_exit(0, "setcchar failed");
+	for(i = 0; i < g_render.ndirty; i++) {
+		row = g_render.dirty_rows[i];
+		g_render.dirty_start[row] = g_render.dirty_end[row] = 0;
+	}
 
-	if(move(pos.row, pos.col) == ERR)
-		err_exit(0, "move failed: %d/%d, %d/%d\n", pos.row, maxy-1, pos.col, maxx-1);
+	g_render.ndirty = 0;
+	g_render.dirty_cells = 0;
+}
 
-	/*if(in_wch(&cur_cch) == ERR)
-		err_exit(0, "in_wch failed");
-	if(cch.attr == cur_cch.attr && wmemcmp(cch.chars, cur_cch.chars, CCHARW_MAX) == 0) {
-		fprintf(stderr, "cur was same\n");
-		return;
-	}*/
+/* runs on the worker threads. each row belongs to
+ * exactly one worker, so only the row's own entries
+ * are written.
+ */
+static void convert_row(void *vts, int i) {
+	int row;
+
+	row = g_render.dirty_rows[i];
+	g_render.stage_len[row] = convert_span(vts, row, &g_render.dirty_start[row], 
+		g_render.dirty_end[row], g_render.stage + row*g_render.cols);
+}
+
+/* for --profile: the number of cells in the staged
+ * span of row that differ from what stdscr has now.
+ */
+static int count_changed(int row) {
+	cchar_t *stage, *prev;
+	wchar_t wch[CCHARW_MAX + 1], prev_wch[CCHARW_MAX + 1];
+	attr_t attr, prev_attr;
+	short pair, prev_pair;
+	int i, changed;
+
+	stage = g_render.stage + row*g_render.cols;
+	prev = g_render.prev;
+	if(mvin_wchnstr(row, g_render.dirty_start[row], prev, g_render.stage_len[row]) == ERR)
+		return g_render.stage_len[row];
+
+	for(i = 0, changed = 0; i < g_render.stage_len[row]; i++) {
+		if(getcchar(&stage[i], wch, &attr, &pair, NULL) == ERR 
+				|| getcchar(&prev[i], prev_wch, &prev_attr, &prev_pair, NULL) == ERR
+				|| attr != prev_attr || pair != prev_pair || wcscmp(wch, prev_wch) != 0)
+			changed++;
+	}
+
+	return changed;
+}
+
+static void render_commit() {
+	int i, row, written, changed;
+	uint64_t start = 0, counting = 0, counted;
+
+	if(profile_enabled)
+		start = profile_now();
+
+	if(g_render.threads > 0 && g_render.dirty_cells >= SCN_PARALLEL_MIN_CELLS)
+		workers_run(convert_row, vterm_obtain_screen(g_vt), g_render.ndirty);
+	else 
+		for(i = 0; i < g_render.ndirty; i++)
+			convert_row(vterm_obtain_screen(g_vt), i);
+
+	/* render_mark already clamped the spans to the screen */
+	for(i = 0, written = 0, changed = 0; i < g_render.ndirty; i++) {
+		row = g_render.dirty_rows[i];
+		/* the count has to see stdscr before this row is
+		 * written, and its own time isnt part of the 
+		 * conversion */
+		if(profile_enabled) {
+			written += g_render.stage_len[row];
+			counted = profile_now();
+			changed += count_changed(row);
+			counting += profile_now() - counted;
+		}
+
+		if(mvadd_wchnstr(row, g_render.dirty_start[row], 
+				g_render.stage + row*g_render.cols, g_render.stage_len[row]) == ERR)
+			err_exit(0, "mvadd_wchnstr failed at %d, %d", row, g_render.dirty_start[row]);
+	}
 
-	if(add_wch(&cch) == ERR && pos.row != (maxy-1) && pos.col != (maxx-1) )
-		err_exit(0, "add_wch failed at %d/%d, %d/%d: ", pos.row, maxy-1, pos.col, maxx-1);
+	METRICS_ADD(MTR_CELLS_UPDATED, g_render.dirty_cells);
+	g_frame.cells += g_render.dirty_cells;
+	render_reset();
 
+	if(profile_enabled)
+		profile_convert(written, changed, profile_now() - start - counting);
+}
+
+/* convert damaged cells on n worker threads (plus 
+ * this one) instead of only this one. must be called
+ * after screen_color_start. 
+ */
+int screen_render_threads(int n) {
+	VTermColor color;
+	int i;
+
+	if(workers_start(n) != 0)
+		return -1;
+
+	/* the workers only read the color tables, 
+	 * so fill them in completely now */
+	for(i = 1; i < SCN_REQ_PAIRS; i++) 
+		init_pair_once(i);
+	for(i = 0; i < SCN_LUT_SIZE; i++) {
+		color.red = (i >> (SCN_LUT_BITS*2)) << SCN_LUT_SHIFT;
+		color.green = ((i >> SCN_LUT_BITS) & ((1 << SCN_LUT_BITS) - 1)) << SCN_LUT_SHIFT;
+		color.blue = (i & ((1 << SCN_LUT_BITS) - 1)) << SCN_LUT_SHIFT;
+		if(g_nearest_lut[i] == 0)
+			g_nearest_lut[i] = nearest_ansi_index(color) + 1;
+	}
+
+	g_render.threads = n;
+	return 0;
 }
 
 void screen_damage_win() {
@@ -359,37 +759,159 @@ void screen_redraw() {
 		err_exit(0, "redrawwin failed!");
 }
 
-void screen_refresh() {
+/* limit the outer tty to about bps bits per second. 
+ * must be called after screen_init.
+ */
+int screen_set_max_bps(long bps) {
+	if( (g_throttle.input = newpad(1, 1)) == NULL 
+			|| nodelay(g_throttle.input, true) == ERR) {
+		errno = SCN_ERR_INIT;
+		return -1;
+	}
+
+	g_throttle.rate = (bps >= 8)? bps/8 : 1;
+	g_throttle.budget = g_throttle.rate * SCN_THROTTLE_WINDOW_MS/1000;
+	if(g_throttle.budget < 1)
+		g_throttle.budget = 1;
+	g_throttle.backlog = 0;
+	if(timer_init(&g_throttle.drained) != 0)
+		return -1;
+	return 0;
+}
+
+/* returns 0 if the whole frame fits in the output queue
+ * (an empty queue always takes a frame, however large).
+ * otherwise draws only the cursor row, if even that 
+ * fits, and returns 1. the lines left untouched are
+ * drawn by a later refresh, by which time curses will
+ * have merged in any newer changes.
+ */
+static int throttle_frame() {
+	int queued, estimate, y;
+	long elapsed;
+
+	elapsed = timer_elapsed(&g_throttle.drained);
+	if(elapsed > 0) {
+		g_throttle.backlog -= elapsed * g_throttle.rate / 1000000;
+		if(g_throttle.backlog < 0)
+			g_throttle.backlog = 0;
+		timer_init(&g_throttle.drained);
+	}
+
+	if(ioctl(STDOUT_FILENO, TIOCOUTQ, &queued) != 0 || queued < g_throttle.backlog)
+		queued = g_throttle.backlog;
+
+	estimate = g_frame.cells + g_frame.switches*SCN_SGR_BYTES;
+	if(estimate > LINES*COLS)
+		estimate = LINES*COLS;
+	if(queued == 0 || queued + estimate <= g_throttle.budget) {
+		g_throttle.backlog += estimate;
+		return 0;
+	}
+
+	if(queued < g_throttle.budget && contained(g_cursor.pos.row, 0) ) {
+		for(y = 0; y < LINES; y++)
+			if(y != g_cursor.pos.row)
+				wtouchln(stdscr, y, 1, 0);
+
+		if(refresh() == ERR)
+			err_exit(0, "refresh failed!");
+		touchwin(stdscr);
+		g_throttle.backlog += COLS;
+	}
+
+	LOGF_DEBUG("held frame: %d bytes queued, about %d to send\n", queued, estimate);
+	return 1;
+}
+
+int screen_refresh() {
+	uint64_t start = 0;
+
+	METRICS_INC(MTR_REFRESHES);
+	TRACE1(refresh_start, g_render.dirty_cells);
+	if(g_render.ndirty > 0)
+		render_commit();
+	commit_cursor();
+
+	if(g_throttle.budget > 0 && throttle_frame() != 0) {
+		METRICS_INC(MTR_FRAMES_HELD);
+		TRACE2(refresh_end, g_frame.cells, 1);
+		return 1;
+	}
+
+	if(profile_enabled)
+		start = profile_now();
 	if(refresh() == ERR)
 		err_exit(0, "refresh failed!");
+	if(profile_enabled)
+		profile_frame(profile_now() - start);
+	TRACE2(refresh_end, g_frame.cells, 0);
+
+	if(g_frame.cells > 0) {
+		LOGF_DEBUG("frame: %d cells, %d attribute runs\n", g_frame.cells, g_frame.switches);
+		g_frame.cells = 0;
+		g_frame.switches = 0;
+	}
+
+	return 0;
 }
 
 int screen_damage(VTermRect rect, void *user) {
-	VTermScreen *vts = vterm_obtain_screen(g_vt);
-	VTermPos pos;
-	int x,y,maxx,maxy;
+	uint64_t start = 0;
 
 	(void)(user); /* user not used */
 
-	/* save cursor value */
-	getyx(stdscr, y, x);
-	getmaxyx(stdscr, maxy, maxx);
+	METRICS_INC(MTR_DAMAGE_CALLS);
+	TRACE4(damage, rect.start_row, rect.end_row, rect.start_col, rect.end_col);
+	if(profile_enabled)
+		start = profile_now();
 
-	for(pos.row = rect.start_row; pos.row < rect.end_row; pos.row++) {
-		for(pos.col = rect.start_col; pos.col < rect.end_col; pos.col++) {
-			update_cell(vts, pos);
-		}
-	}
+	render_mark(rect);
 
-	/* restore cursor (repainting shouldnt modify cursor) */
-	if(move(y,x) == ERR) 
-		err_exit(0, "move failed: %d/%d %d/%d", y, maxy, x, maxx);
+	if(snapshot_enabled)
+		snapshot_mark(rect.start_row, rect.end_row);
+	if(profile_enabled)
+		profile_damage((rect.end_row - rect.start_row)*(rect.end_col - rect.start_col), 
+			profile_now() - start);
 
 	/*fprintf(stderr, "\tdamage: (%d,%d) (%d,%d) \n", rect.start_row, rect.start_col, rect.end_row, rect.end_col);*/
 
 	return 1;
 }
 
+/* draw ch underlined at pos without changing the 
+ * vterm screen. the cell keeps its colors so the
+ * overlay blends in with what is around it. the 
+ * overlay is erased by damage to pos.
+ */
+void screen_draw_overlay(VTermPos pos, uint32_t ch) {
+	VTermScreen *vts = vterm_obtain_screen(g_vt);
+	VTermScreenCell cell;
+	attr_t attr;
+	short pair;
+	cchar_t cch;
+	wchar_t wch[2];
+
+	if(!contained(pos.row, pos.col) )
+		return;
+
+	/* pending damage would paint over the overlay */
+	if(g_render.ndirty > 0)
+		render_commit();
+
+	vterm_screen_get_cell(vts, pos, &cell);
+	to_curses_attr(&cell, &attr, &pair);
+
+	wch[0] = (wchar_t) ch;
+	wch[1] = L'\0';
+	if(setcchar(&cch, wch, attr | A_UNDERLINE, pair, NULL) == ERR)
+		err_exit(0, "setcchar failed");
+
+	/* add_wch fails at the bottom right corner, 
+	 * which is fine for an overlay */
+	mvadd_wch(pos.row, pos.col, &cch);
+}
+
 /*
 int screen_moverect(VTermRect dest, VTermRect src, void *user) {
 	
@@ -401,17 +923,9 @@ int screen_movecursor(VTermPos pos, VTermPos oldpos, int visible, void *user) {
 	(void)(user); /* user is not used */
 	(void)(oldpos); /* oldpos not used */
 	(void)(visible);
-		
-	/* sometimes this happens when
-	 * a window resize recently happened
-	 */
-	if(!contained(pos.row, pos.col) ) {
-		fprintf(stderr, "tried to move cursor out of bounds to %d/%d %d/%d\n", pos.row, LINES-1, pos.col, COLS-1);
-		return 1;
-	}
 
-	if(move(pos.row, pos.col) == ERR)
-		err_exit(0, "move failed: %d/%d %d/%d", pos.row, LINES-1, pos.col, COLS-1);
+	/* applied by commit_cursor before the next refresh */
+	g_cursor.pos = pos;
 
 	/*fprintf(stderr, "\tmove cursor: %d, %d\n", pos.row, pos.col);*/
 
@@ -422,7 +936,7 @@ int screen_bell(void *user) {
 	(void)(user);
 
 	if(beep() == ERR) {
-		fprintf(stderr, "bell failed\n");
+		LOGF_WARN("bell failed\n");
 	}
 
 	/*if(flash() == ERR) {
@@ -431,6 +945,56 @@ int screen_bell(void *user) {
 	return 1;
 }
 
+/* whether color is the placeholder for the 
+ * terminal's default color */
+int screen_default_color(const VTermColor *color) {
+	return vterm_color_equal(color, &DEFAULT_COLOR);
+}
+
+/* ring the bell, or flash the screen if visual */
+void screen_alert(int visual) {
+	if( (visual? flash() : beep()) == ERR)
+		LOGF_WARN("alert failed\n");
+}
+
+/* vterm has already switched buffers by the time this
+ * is called, so damage to the primary screen that 
+ * hasnt been converted yet is lost to the copy. 
+ */
+static void switch_screen(int alt) {
+	if(alt) {
+		g_shadow.valid = 0;
+		if(g_render.ndirty > 0)
+			return;
+
+		if(g_shadow.win != NULL && (getmaxy(g_shadow.win) != LINES || getmaxx(g_shadow.win) != COLS) ) {
+			delwin(g_shadow.win);
+			g_shadow.win = NULL;
+		}
+		if(g_shadow.win == NULL && (g_shadow.win = newwin(LINES, COLS, 0, 0)) == NULL) {
+			LOGF_WARN("failed to allocate shadow window\n");
+			return;
+		}
+
+		if(overwrite(stdscr, g_shadow.win) == ERR)
+			err_exit(0, "overwrite failed!");
+		g_shadow.valid = 1;
+		return;
+	}
+
+	if(!g_shadow.valid)
+		return; /* convert the full damage vterm just sent */
+
+	/* the only damage since the copy was made is to 
+	 * the alternate screen and the full damage vterm
+	 * sent for the switch, the copy covers all of it */
+	render_reset();
+	if(overwrite(g_shadow.win, stdscr) == ERR)
+		err_exit(0, "overwrite failed!");
+	g_shadow.valid = 0;
+	LOGF_DEBUG("restored primary screen from shadow\n");
+}
+
 int screen_settermprop(VTermProp prop, VTermValue *val, void *user) {
 	
 	(void)(user);
@@ -439,9 +1003,10 @@ int screen_settermprop(VTermProp prop, VTermValue *val, void *user) {
 	switch(prop) { 
 	case VTERM_PROP_CURSORVISIBLE:
 		/* fprintf(stderr, " (CURSORVISIBLE) = %02x", val->boolean); */
-		/* will return ERR if cursor not supported, *
-		 * so we dont bother checking return value  */
-		curs_set(!!val->boolean); 
+		g_cursor.visible = !!val->boolean;
+		break;
+	case VTERM_PROP_ALTSCREEN:
+		switch_screen(val->boolean);
 		break;
 	case VTERM_PROP_CURSORBLINK: /* not sure if ncurses can change blink settings */
 		/* fprintf(stderr, " (CURSORBLINK) = %02x", val->boolean); */
@@ -461,14 +1026,42 @@ int screen_settermprop(VTermProp prop, VTermValue *val, void *user) {
 	return 1;
 }
 
-/* this should be called before vterm_set_size
- * which will cause the term damage callback
- * to fully rewrite the screen.
+/* resize curses to the terminal's new size. the cells 
+ * in the area both sizes share are kept, both in stdscr
+ * and in curses' idea of what the terminal shows, so 
+ * only cells that are newly exposed or that vterm 
+ * damages while resizing get redrawn. this assumes the
+ * terminal keeps the top left of the screen too, which
+ * terminals do on the alternate screen that curses
+ * runs in.
  */
 void screen_resize() {
-	if(endwin() == ERR)
-		err_exit(0, "endwin failed!");
+	struct winsize size;
+	struct timer_t timer;
+	int rows, cols;
 
-	if(refresh() == ERR)
-		err_exit(0, "refresh failed!");
+	timer_init(&timer);
+	rows = LINES;
+	cols = COLS;
+
+	/* pending damage was for the old size */
+	if(g_render.ndirty > 0)
+		render_commit();
+
+	if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 0 && size.ws_col > 0) {
+		if(resize_term(size.ws_row, size.ws_col) == ERR)
+			err_exit(0, "resize_term failed!");
+	}
+	else {
+		/* let curses find the size and redraw everything */
+		if(endwin() == ERR)
+			err_exit(0, "endwin failed!");
+
+		if(refresh() == ERR)
+			err_exit(0, "refresh failed!");
+	}
+
+	render_alloc(LINES, COLS);
+	g_shadow.valid = 0;
+	LOGF_DEBUG("resize from %dx%d took %d usec\n", rows, cols, (int) timer_elapsed(&timer));
 }
\ No newline at end of file
@@ -19,6 +19,7 @@
 #ifndef NCTE_SCREEN_H
 #define NCTE_SCREEN_H
 
+#include <stdint.h>
 #include "vterm.h"
 
 enum screen_err {
@@ -28,23 +29,30 @@ enum screen_err {
 	SCN_ERR_COLOR_COLORS,
 	SCN_ERR_COLOR_NOT_SUPPORTED,
 	SCN_ERR_COLOR_NO_DEFAULT,
-	SCN_ERR_COLOR_PAIR_INIT
+	SCN_ERR_COLOR_PAIR_INIT,
+	SCN_ERR_PALETTE
 
 };
 
 int screen_init();
 void screen_free();
 void screen_set_term(VTerm *term);
+int screen_set_palette(int colors);
+int screen_render_threads(int n);
 void screen_dims(unsigned short *rows, unsigned short *cols);
 int screen_getch(int *ch);
 /*void screen_err_msg(int error, char **msg);*/
 int screen_color_start();
 int screen_damage(VTermRect rect, void *user);
+void screen_draw_overlay(VTermPos pos, uint32_t ch);
 void screen_damage_win();
 void screen_redraw();
-void screen_refresh();
+int screen_set_max_bps(long bps);
+int screen_refresh();
 int screen_movecursor(VTermPos pos, VTermPos oldpos, int visible, void *user);
 int screen_bell(void *user);
+void screen_alert(int visual);
+int screen_default_color(const VTermColor *color);
 int screen_settermprop(VTermProp prop, VTermValue *val, void *user);
 void screen_resize();
 #endif /* NCTE_SCREEN_H */
\ No newline at end of file
@@ -0,0 +1,650 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* saves the vterm screen to a file so a restarted ncte
+ * can put it back with --restore. the file is a log of
+ * records: a full snapshot (the size, every row and the
+ * cursor) followed by the rows that were damaged since,
+ * appended at most once per SNAPSHOT_INTERVAL. once the
+ * appended records outgrow the full snapshot a few times
+ * over, a new full snapshot replaces the file. 
+ *
+ * records:
+ *	'S' rows:16 cols:16
+ *	'R' row:16 nruns:16, then nruns of len:16 cell
+ *	'C' row:16 col:16
+ * a cell is nchars:8 chars:32*nchars width:8 attrs:16 
+ * fg:24 bg:24. numbers are little endian. 
+ */
+
+#include "snapshot.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "timer.h"
+#include "log.h"
+#include "screen.h"
+#include "vterm_util.h"
+
+#define SNAPSHOT_MAGIC "NCTESNP1"
+#define SNAPSHOT_MAGIC_LEN 8
+#define SNAPSHOT_INTERVAL 1000000 /* usec between appends */
+#define SNAPSHOT_COMPACT 4 /* rewrite once the appends are this many times a full snapshot */
+#define SNAPSHOT_CELL_MAX (1 + 4*VTERM_MAX_CHARS_PER_CELL + 1 + 2 + 3 + 3)
+#define SNAPSHOT_SGR_MAX 64 /* longest sgr sequence restore_row writes */
+#define SNAPSHOT_CELLS_MAX (1 << 20) /* a bigger saved screen is taken as corrupt */
+
+enum snapshot_record {
+	REC_SIZE = 'S',
+	REC_ROW = 'R',
+	REC_CURSOR = 'C'
+};
+
+int snapshot_enabled = 0;
+
+static struct {
+	VTerm *vt;
+	char *path, *tmp_path;
+	FILE *fp;
+	int rows, cols;
+	unsigned char *dirty; /* rows damaged since the last write */
+	int ndirty;
+	VTermPos cursor; /* last cursor written */
+	unsigned char *buf; /* one encoded row */
+	size_t len;
+	long full_bytes; /* size of the last full snapshot */
+	long log_bytes; /* size of the file */
+	struct timer_t written;
+} g_snap;
+
+static void put8(unsigned int v) {
+	g_snap.buf[g_snap.len++] = v & 0xff;
+}
+
+static void put16(unsigned int v) {
+	put8(v);
+	put8(v >> 8);
+}
+
+static void put32(uint32_t v) {
+	put16(v & 0xffff);
+	put16(v >> 16);
+}
+
+static void put_color(const VTermColor *color) {
+	put8(color->red);
+	put8(color->green);
+	put8(color->blue);
+}
+
+static int cell_nchars(const VTermScreenCell *cell) {
+	int n;
+
+	for(n = 0; n < VTERM_MAX_CHARS_PER_CELL && cell->chars[n] != 0; n++)
+		;
+	return n;
+}
+
+static unsigned int cell_attrs(const VTermScreenCell *cell) {
+	return cell->attrs.bold | cell->attrs.underline << 1 | cell->attrs.italic << 3 
+		| cell->attrs.blink << 4 | cell->attrs.reverse << 5 | cell->attrs.strike << 6
+		| cell->attrs.font << 8;
+}
+
+static void set_cell_attrs(VTermScreenCell *cell, unsigned int attrs) {
+	cell->attrs.bold = attrs & 1;
+	cell->attrs.underline = (attrs >> 1) & 3;
+	cell->attrs.italic = (attrs >> 3) & 1;
+	cell->attrs.blink = (attrs >> 4) & 1;
+	cell->attrs.reverse = (attrs >> 5) & 1;
+	cell->attrs.strike = (attrs >> 6) & 1;
+	cell->attrs.font = (attrs >> 8) & 0xf;
+}
+
+static int same_pen(const VTermScreenCell *a, const VTermScreenCell *b) {
+	return cell_attrs(a) == cell_attrs(b) 
+		&& vterm_color_equal(&a->fg, &b->fg) && vterm_color_equal(&a->bg, &b->bg);
+}
+
+static int same_cell(const VTermScreenCell *a, const VTermScreenCell *b) {
+	int n = cell_nchars(a);
+
+	return n == cell_nchars(b) && memcmp(a->chars, b->chars, n*sizeof(uint32_t)) == 0
+		&& a->width == b->width && same_pen(a, b);
+}
+
+static void put_cell(const VTermScreenCell *cell) {
+	int i, n;
+
+	n = cell_nchars(cell);
+	put8(n);
+	for(i = 0; i < n; i++)
+		put32(cell->chars[i]);
+	put8(cell->width);
+	put16(cell_attrs(cell));
+	put_color(&cell->fg);
+	put_color(&cell->bg);
+}
+
+static void get_cell(VTermScreen *vts, int row, int col, VTermScreenCell *cell) {
+	VTermPos pos = {.row = row, .col = col};
+
+	if(vterm_screen_get_cell(vts, pos, cell) == 0)
+		memset(cell, 0, sizeof(*cell));
+}
+
+/* runs of identical cells are stored once, so blank
+ * space costs a few bytes per row */
+static void encode_row(int row) {
+	VTermScreen *vts = vterm_obtain_screen(g_snap.vt);
+	VTermScreenCell run, cell;
+	size_t nruns_at;
+	int col, len, nruns;
+
+	g_snap.len = 0;
+	put8(REC_ROW);
+	put16(row);
+	nruns_at = g_snap.len;
+	put16(0);
+
+	get_cell(vts, row, 0, &run);
+	for(col = 1, len = 1, nruns = 0; col < g_snap.cols; col++) {
+		get_cell(vts, row, col, &cell);
+		if(same_cell(&cell, &run) ) {
+			len++;
+			continue;
+		}
+
+		put16(len);
+		put_cell(&run);
+		nruns++;
+		run = cell;
+		len = 1;
+	}
+
+	put16(len);
+	put_cell(&run);
+	nruns++;
+
+	g_snap.buf[nruns_at] = nruns & 0xff;
+	g_snap.buf[nruns_at + 1] = nruns >> 8;
+}
+
+static int write_buf() {
+	if(fwrite(g_snap.buf, 1, g_snap.len, g_snap.fp) != g_snap.len)
+		return -1;
+
+	g_snap.log_bytes += g_snap.len;
+	return 0;
+}
+
+static int write_cursor() {
+	vterm_state_get_cursorpos(vterm_obtain_state(g_snap.vt), &g_snap.cursor);
+	g_snap.len = 0;
+	put8(REC_CURSOR);
+	put16(g_snap.cursor.row);
+	put16(g_snap.cursor.col);
+	return write_buf();
+}
+
+static int write_row(int row) {
+	encode_row(row);
+	return write_buf();
+}
+
+static void clear_dirty() {
+	memset(g_snap.dirty, 0, g_snap.rows);
+	g_snap.ndirty = 0;
+}
+
+/* the screen size changed, so the buffers do too */
+static int resize(int rows, int cols) {
+	free(g_snap.dirty);
+	free(g_snap.buf);
+	g_snap.dirty = malloc(rows);
+	g_snap.buf = malloc(8 + cols*(2 + SNAPSHOT_CELL_MAX));
+	if(g_snap.dirty == NULL || g_snap.buf == NULL)
+		return -1;
+
+	g_snap.rows = rows;
+	g_snap.cols = cols;
+	clear_dirty();
+	return 0;
+}
+
+/* write a full snapshot next to the file and move it
+ * into place, so a crash never leaves a half written 
+ * one. further appends go to the new file.
+ */
+static int write_full() {
+	FILE *fp;
+	int row;
+
+	if( (fp = fopen(g_snap.tmp_path, "wb")) == NULL)
+		return -1;
+	if(g_snap.fp != NULL)
+		fclose(g_snap.fp);
+	g_snap.fp = fp;
+	g_snap.log_bytes = 0;
+
+	g_snap.len = 0;
+	memcpy(g_snap.buf, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN);
+	g_snap.len = SNAPSHOT_MAGIC_LEN;
+	put8(REC_SIZE);
+	put16(g_snap.rows);
+	put16(g_snap.cols);
+	if(write_buf() != 0)
+		return -1;
+
+	for(row = 0; row < g_snap.rows; row++)
+		if(write_row(row) != 0)
+			return -1;
+
+	if(write_cursor() != 0 || fflush(fp) != 0 || fsync(fileno(fp)) != 0 
+			|| rename(g_snap.tmp_path, g_snap.path) != 0)
+		return -1;
+
+	g_snap.full_bytes = g_snap.log_bytes;
+	clear_dirty();
+	LOGF_DEBUG("snapshot: wrote %d bytes for %dx%d\n", (int) g_snap.full_bytes, g_snap.rows, g_snap.cols);
+	return 0;
+}
+
+static int write_dirty() {
+	int row;
+
+	if(g_snap.log_bytes > SNAPSHOT_COMPACT*g_snap.full_bytes)
+		return write_full();
+
+	for(row = 0; row < g_snap.rows; row++)
+		if(g_snap.dirty[row] && write_row(row) != 0)
+			return -1;
+
+	if(write_cursor() != 0 || fflush(g_snap.fp) != 0)
+		return -1;
+
+	clear_dirty();
+	return 0;
+}
+
+static int cursor_moved() {
+	VTermPos pos;
+
+	vterm_state_get_cursorpos(vterm_obtain_state(g_snap.vt), &pos);
+	return pos.row != g_snap.cursor.row || pos.col != g_snap.cursor.col;
+}
+
+/* start snapshotting vt to path. */
+int snapshot_open(const char *path, VTerm *vt) {
+	int rows, cols;
+
+	g_snap.vt = vt;
+	g_snap.path = strdup(path);
+	if(g_snap.path == NULL || (g_snap.tmp_path = malloc(strlen(path) + 5)) == NULL)
+		return -1;
+	sprintf(g_snap.tmp_path, "%s.tmp", path);
+
+	vterm_get_size(vt, &rows, &cols);
+	if(resize(rows, cols) != 0 || write_full() != 0)
+		return -1;
+
+	timer_init(&g_snap.written);
+	snapshot_enabled = 1;
+	return 0;
+}
+
+void snapshot_mark(int start_row, int end_row) {
+	int row;
+
+	for(row = start_row; row < end_row && row < g_snap.rows; row++) {
+		if(g_snap.dirty[row] == 0) {
+			g_snap.dirty[row] = 1;
+			g_snap.ndirty++;
+		}
+	}
+}
+
+/* returns 1 if there is something to write */
+int snapshot_dirty() {
+	return snapshot_enabled && (g_snap.ndirty > 0 || cursor_moved() );
+}
+
+static void stop_if_failed(int status) {
+	if(status == 0)
+		return;
+
+	LOGF_WARN("snapshot: write failed with errno %d, no longer taking snapshots\n", errno);
+	snapshot_enabled = 0;
+	snapshot_close();
+}
+
+/* write what changed if SNAPSHOT_INTERVAL has passed 
+ * since the last write */
+void snapshot_tick() {
+	int rows, cols;
+
+	if(!snapshot_enabled)
+		return;
+
+	vterm_get_size(g_snap.vt, &rows, &cols);
+	if(rows != g_snap.rows || cols != g_snap.cols)
+		stop_if_failed( (resize(rows, cols) == 0)? write_full() : -1);
+	else if(snapshot_dirty() && timer_thresh(&g_snap.written, 0, SNAPSHOT_INTERVAL) == 1)
+		stop_if_failed(write_dirty() );
+	else
+		return;
+
+	timer_init(&g_snap.written);
+}
+
+void snapshot_close() {
+	if(snapshot_enabled && snapshot_dirty() && write_dirty() != 0)
+		LOGF_WARN("snapshot: final write failed with errno %d\n", errno);
+
+	snapshot_enabled = 0;
+	if(g_snap.fp != NULL)
+		fclose(g_snap.fp);
+	free(g_snap.path);
+	free(g_snap.tmp_path);
+	free(g_snap.dirty);
+	free(g_snap.buf);
+	memset(&g_snap, 0, sizeof(g_snap));
+}
+
+struct reader {
+	const unsigned char *p, *end;
+	int short_read; /* ran off the end of the file */
+};
+
+static unsigned int get8(struct reader *r) {
+	if(r->p >= r->end) {
+		r->short_read = 1;
+		return 0;
+	}
+
+	return *r->p++;
+}
+
+static unsigned int get16(struct reader *r) {
+	unsigned int lo = get8(r);
+
+	return lo | get8(r) << 8;
+}
+
+static uint32_t get32(struct reader *r) {
+	uint32_t lo = get16(r);
+
+	return lo | (uint32_t) get16(r) << 16;
+}
+
+static void get_color(struct reader *r, VTermColor *color) {
+	color->red = get8(r);
+	color->green = get8(r);
+	color->blue = get8(r);
+}
+
+static int read_cell(struct reader *r, VTermScreenCell *cell) {
+	int i, n;
+
+	memset(cell, 0, sizeof(*cell));
+	if( (n = get8(r)) > VTERM_MAX_CHARS_PER_CELL)
+		return -1;
+	for(i = 0; i < n; i++)
+		cell->chars[i] = get32(r);
+	cell->width = get8(r);
+	set_cell_attrs(cell, get16(r) );
+	get_color(r, &cell->fg);
+	get_color(r, &cell->bg);
+	return r->short_read? -1 : 0;
+}
+
+/* decode a row record into scratch and only then copy
+ * it to the screen, so a row cut off by a crash is 
+ * left as it was */
+static int read_row(struct reader *r, VTermScreenCell *screen, int rows, int cols, VTermScreenCell *scratch) {
+	VTermScreenCell cell;
+	int row, nruns, col, len;
+
+	row = get16(r);
+	nruns = get16(r);
+	for(col = 0; nruns > 0; nruns--) {
+		len = get16(r);
+		if(read_cell(r, &cell) != 0 || len > cols - col)
+			return -1;
+		while(len-- > 0)
+			scratch[col++] = cell;
+	}
+
+	if(r->short_read || row >= rows || col != cols)
+		return -1;
+
+	memcpy(screen + row*cols, scratch, sizeof(VTermScreenCell)*cols);
+	return 0;
+}
+
+static int put_utf8(char *out, uint32_t ch) {
+	if(ch < 0x80) {
+		out[0] = ch;
+		return 1;
+	}
+	if(ch < 0x800) {
+		out[0] = 0xc0 | (ch >> 6);
+		out[1] = 0x80 | (ch & 0x3f);
+		return 2;
+	}
+	if(ch < 0x10000) {
+		out[0] = 0xe0 | (ch >> 12);
+		out[1] = 0x80 | ((ch >> 6) & 0x3f);
+		out[2] = 0x80 | (ch & 0x3f);
+		return 3;
+	}
+
+	out[0] = 0xf0 | ((ch >> 18) & 0x07);
+	out[1] = 0x80 | ((ch >> 12) & 0x3f);
+	out[2] = 0x80 | ((ch >> 6) & 0x3f);
+	out[3] = 0x80 | (ch & 0x3f);
+	return 4;
+}
+
+static int put_sgr(char *out, const VTermScreenCell *cell) {
+	int n;
+
+	n = sprintf(out, "\033[0");
+	if(cell->attrs.bold)
+		n += sprintf(out + n, ";1");
+	if(cell->attrs.italic)
+		n += sprintf(out + n, ";3");
+	if(cell->attrs.underline)
+		n += sprintf(out + n, (cell->attrs.underline == 1)? ";4" : ";21");
+	if(cell->attrs.blink)
+		n += sprintf(out + n, ";5");
+	if(cell->attrs.reverse)
+		n += sprintf(out + n, ";7");
+	if(cell->attrs.strike)
+		n += sprintf(out + n, ";9");
+	if(cell->attrs.font)
+		n += sprintf(out + n, ";%d", 10 + cell->attrs.font);
+	if(!screen_default_color(&cell->fg) )
+		n += sprintf(out + n, ";38;2;%d;%d;%d", cell->fg.red, cell->fg.green, cell->fg.blue);
+	if(!screen_default_color(&cell->bg) )
+		n += sprintf(out + n, ";48;2;%d;%d;%d", cell->bg.red, cell->bg.green, cell->bg.blue);
+
+	out[n++] = 'm';
+	return n;
+}
+
+static int blank_cell(const VTermScreenCell *cell) {
+	return (cell->chars[0] == 0 || cell->chars[0] == ' ') && !cell->attrs.underline 
+		&& !cell->attrs.reverse && !cell->attrs.strike && screen_default_color(&cell->bg);
+}
+
+/* the escape sequences that draw a row of cells on a 
+ * freshly reset vterm. trailing blanks are left out. */
+static size_t restore_row(char *out, const VTermScreenCell *cells, int row, int cols) {
+	int col, end, i;
+	size_t n;
+
+	for(end = cols; end > 0 && blank_cell(&cells[end - 1]); end--)
+		;
+
+	n = sprintf(out, "\033[%d;1H", row + 1);
+	for(col = 0; col < end; col++) {
+		/* the right half of a wide character */
+		if(cells[col].chars[0] == (uint32_t) -1)
+			continue;
+
+		if(col == 0 || !same_pen(&cells[col], &cells[col - 1]) )
+			n += put_sgr(out + n, &cells[col]);
+
+		if(cells[col].chars[0] == 0)
+			out[n++] = ' ';
+		for(i = 0; i < VTERM_MAX_CHARS_PER_CELL && cells[col].chars[i] != 0; i++)
+			n += put_utf8(out + n, cells[col].chars[i]);
+	}
+
+	n += sprintf(out + n, "\033[0m");
+	return n;
+}
+
+static void restore_screen(VTerm *vt, const VTermScreenCell *screen, int rows, int cols, VTermPos cursor) {
+	char *out;
+	size_t n;
+	int row, vt_rows, vt_cols, draw_cols;
+
+	vterm_get_size(vt, &vt_rows, &vt_cols);
+	draw_cols = (cols < vt_cols)? cols : vt_cols;
+	if( (out = malloc(32 + draw_cols*(SNAPSHOT_SGR_MAX + 4*VTERM_MAX_CHARS_PER_CELL) )) == NULL)
+		return;
+
+	for(row = 0; row < rows && row < vt_rows; row++) {
+		n = restore_row(out, screen + row*cols, row, draw_cols);
+		vterm_push_bytes(vt, out, n);
+	}
+
+	n = sprintf(out, "\033[%d;%dH", 
+		((cursor.row < vt_rows)? cursor.row : vt_rows - 1) + 1, 
+		((cursor.col < vt_cols)? cursor.col : vt_cols - 1) + 1);
+	vterm_push_bytes(vt, out, n);
+	free(out);
+}
+
+static unsigned char *read_file(const char *path, size_t *len) {
+	FILE *fp;
+	unsigned char *data = NULL, *bigger;
+	size_t size = 0, n;
+
+	if( (fp = fopen(path, "rb")) == NULL)
+		return NULL;
+
+	*len = 0;
+	do {
+		if(*len == size) {
+			size = (size == 0)? 65536 : size*2;
+			if( (bigger = realloc(data, size)) == NULL) {
+				free(data);
+				fclose(fp);
+				return NULL;
+			}
+			data = bigger;
+		}
+
+		*len += (n = fread(data + *len, 1, size - *len, fp));
+	} while(n > 0);
+
+	if(ferror(fp) ) {
+		free(data);
+		data = NULL;
+	}
+	fclose(fp);
+	return data;
+}
+
+/* draw the screen saved in path on vt, which should
+ * have just been reset. a record cut off at the end of
+ * the file (e.g. by a crash) ends the restore early. if
+ * the size differs, the saved screen is clipped.
+ */
+int snapshot_restore(const char *path, VTerm *vt) {
+	struct reader r;
+	unsigned char *data;
+	size_t len;
+	VTermScreenCell *screen = NULL, *scratch = NULL;
+	VTermPos cursor = {0, 0};
+	int rows = 0, cols = 0, type, records = 0;
+
+	if( (data = read_file(path, &len)) == NULL)
+		return -1;
+
+	if(len < SNAPSHOT_MAGIC_LEN || memcmp(data, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN) != 0) {
+		free(data);
+		errno = EINVAL;
+		return -1;
+	}
+
+	r.p = data + SNAPSHOT_MAGIC_LEN;
+	r.end = data + len;
+	r.short_read = 0;
+	while(r.p < r.end) {
+		type = get8(&r);
+		if(type == REC_SIZE) {
+			rows = get16(&r);
+			cols = get16(&r);
+			free(screen);
+			free(scratch);
+			screen = scratch = NULL;
+			if(r.short_read || rows == 0 || cols == 0 
+					|| (size_t) rows*(size_t) cols > SNAPSHOT_CELLS_MAX)
+				break;
+
+			screen = calloc((size_t) rows*(size_t) cols, sizeof(VTermScreenCell));
+			scratch = malloc((size_t) cols*sizeof(VTermScreenCell));
+			if(screen == NULL || scratch == NULL)
+				break;
+		}
+		else if(type == REC_ROW && screen != NULL) {
+			if(read_row(&r, screen, rows, cols, scratch) != 0)
+				break;
+		}
+		else if(type == REC_CURSOR) {
+			cursor.row = get16(&r);
+			cursor.col = get16(&r);
+			if(r.short_read)
+				break;
+		}
+		else
+			break;
+		records++;
+	}
+
+	if(r.p < r.end || r.short_read)
+		LOGF_WARN("snapshot: stopped restoring at byte %d of %d\n", (int) (r.p - data), (int) len);
+	LOGF_INFO("snapshot: restored %d records, %dx%d\n", records, rows, cols);
+
+	if(screen != NULL && rows > 0 && cols > 0)
+		restore_screen(vt, screen, rows, cols, cursor);
+
+	free(screen);
+	free(scratch);
+	free(data);
+	return 0;
+}
@@ -0,0 +1,37 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef NCTE_SNAPSHOT_H
+#define NCTE_SNAPSHOT_H
+
+#include "vterm.h"
+
+/* nonzero with --snapshot. screen_damage only marks 
+ * rows for the snapshot when this is set. 
+ */
+extern int snapshot_enabled;
+
+int snapshot_open(const char *path, VTerm *vt);
+void snapshot_mark(int start_row, int end_row);
+int snapshot_dirty();
+void snapshot_tick();
+void snapshot_close();
+int snapshot_restore(const char *path, VTerm *vt);
+
+#endif /* NCTE_SNAPSHOT_H */
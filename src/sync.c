@@ -0,0 +1,145 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* synchronized output (DECSET 2026): the child sends
+ * CSI ? 2026 h before it redraws and CSI ? 2026 l when
+ * it is done, so refreshes in between would only show
+ * a half drawn frame. libvterm doesnt know the mode,
+ * so the pty stream is scanned for it before vterm 
+ * sees it. the sequence may be split across reads, so
+ * the scanner keeps its state between calls.
+ */
+
+#include "sync.h"
+#include <string.h>
+
+#include "timer.h"
+#include "log.h"
+
+#define SYNC_MODE 2026
+#define SYNC_TIMEOUT 150000 /* usec to hold refreshes for an unfinished update */
+#define SYNC_PARAM_MAX 100000 /* stop accumulating absurd parameters */
+
+enum sync_state {
+	SYNC_GROUND = 0,
+	SYNC_ESC, /* saw ESC */
+	SYNC_CSI, /* saw ESC [ */
+	SYNC_PARAMS /* saw ESC [ ? */
+};
+
+static struct {
+	int state;
+	int param; /* parameter being parsed */
+	int found; /* SYNC_MODE was one of the parameters */
+	int open; /* an update is in progress */
+	int ended; /* an update ended since sync_ended was last called */
+	int timed_out;
+	struct timer_t begin;
+} g_sync;
+
+static void set_mode(int on) {
+	if(on) {
+		if(!g_sync.open) 
+			timer_init(&g_sync.begin);
+		g_sync.open = 1;
+		g_sync.timed_out = 0;
+	}
+	else if(g_sync.open) {
+		g_sync.open = 0;
+		g_sync.ended = 1;
+	}
+}
+
+void sync_scan(const char *buf, size_t len) {
+	const char *end = buf + len;
+	const char *esc;
+	char ch;
+
+	while(buf < end) {
+		/* nearly all output is outside escape sequences */
+		if(g_sync.state == SYNC_GROUND) {
+			if( (esc = memchr(buf, '\033', end - buf)) == NULL)
+				return;
+			buf = esc + 1;
+			g_sync.state = SYNC_ESC;
+			continue;
+		}
+
+		ch = *buf++;
+		switch(g_sync.state) {
+		case SYNC_ESC:
+			g_sync.state = (ch == '[')? SYNC_CSI : SYNC_GROUND;
+			break;
+
+		case SYNC_CSI:
+			if(ch == '?') {
+				g_sync.state = SYNC_PARAMS;
+				g_sync.param = 0;
+				g_sync.found = 0;
+			}
+			else
+				g_sync.state = SYNC_GROUND;
+			break;
+
+		case SYNC_PARAMS:
+			if(ch >= '0' && ch <= '9') {
+				if(g_sync.param < SYNC_PARAM_MAX)
+					g_sync.param = g_sync.param*10 + (ch - '0');
+				break;
+			}
+
+			if(g_sync.param == SYNC_MODE)
+				g_sync.found = 1;
+			g_sync.param = 0;
+
+			if(ch == ';')
+				break;
+
+			if(g_sync.found && (ch == 'h' || ch == 'l') )
+				set_mode(ch == 'h');
+			g_sync.state = (ch == '\033')? SYNC_ESC : SYNC_GROUND;
+			break;
+		}
+	}
+}
+
+/* returns 1 while refreshes should be held back for 
+ * an update in progress. gives up on updates that 
+ * take longer than SYNC_TIMEOUT, e.g. if the child
+ * died without ending one.
+ */
+int sync_held() {
+	if(!g_sync.open || g_sync.timed_out)
+		return 0;
+
+	if(timer_thresh(&g_sync.begin, 0, SYNC_TIMEOUT) != 0) {
+		LOGF_INFO("synchronized update not ended after %d usec\n", SYNC_TIMEOUT);
+		g_sync.timed_out = 1;
+		return 0;
+	}
+
+	return 1;
+}
+
+/* returns 1 once after each update ends */
+int sync_ended() {
+	int ended = g_sync.ended;
+
+	g_sync.ended = 0;
+	return ended;
+}
@@ -17,8 +17,22 @@
  */
 #include "timer.h"
 
+static int wall_clock(struct timeval *now) {
+	return gettimeofday(now, NULL);
+}
+
+static timer_clock_fn g_clock = wall_clock;
+
+/* replace the clock all timers read, e.g. with a 
+ * virtual clock for tests. NULL restores the wall
+ * clock.
+ */
+void timer_set_clock(timer_clock_fn fn) {
+	g_clock = (fn != NULL)? fn : wall_clock;
+}
+
 int timer_init(struct timer_t *timer) {
-	if(gettimeofday(&timer->start, NULL) != 0)
+	if(g_clock(&timer->start) != 0)
 		return -1;
 
 	return 0;
@@ -34,7 +48,7 @@ int timer_thresh(struct timer_t *timer, int sec, int usec) {
 	amt.tv_sec = sec;
 	amt.tv_usec = usec;
 
-	if(gettimeofday(&now, NULL) != 0)
+	if(g_clock(&now) != 0)
 		return -1;
 
 	timersub(&now, &timer->start, &diff);
@@ -44,3 +58,16 @@ int timer_thresh(struct timer_t *timer, int sec, int usec) {
 	return 0;
 }
 
+/* returns the microseconds elapsed since timer
+ * was initialized or -1 on error with errno set.
+ */
+long timer_elapsed(struct timer_t *timer) {
+	struct timeval now, diff;
+
+	if(g_clock(&now) != 0)
+		return -1;
+
+	timersub(&now, &timer->start, &diff);
+	return diff.tv_sec*1000000 + diff.tv_usec;
+}
+
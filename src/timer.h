@@ -25,7 +25,13 @@ struct timer_t {
 	struct timeval start;
 };
 
+/* fills in the current time like gettimeofday, 
+ * returns -1 on error with errno set */
+typedef int (*timer_clock_fn)(struct timeval *now);
+
+void timer_set_clock(timer_clock_fn fn);
 int timer_init(struct timer_t *timer);
 int timer_thresh(struct timer_t *timer, int sec, int usec);
+long timer_elapsed(struct timer_t *timer);
 
 #endif /* NCTE_TIMER_H */
\ No newline at end of file
@@ -0,0 +1,49 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NCTE_TRACE_H
+#define NCTE_TRACE_H
+
+/* static tracepoints for bpftrace, perf or systemtap, 
+ * all under the "ncte" provider. they are only built 
+ * in with `make USDT=1` (which needs sys/sdt.h) and 
+ * compile to nothing otherwise, arguments included.
+ *
+ *   bpftrace -e 'usdt:./ncte:ncte:pty_read { @ = hist(arg0); }'
+ *
+ * probes:
+ *   pty_read(bytes), pty_write(bytes)
+ *   push_start(bytes), push_end(bytes): around vterm_push_bytes
+ *   damage(start_row, end_row, start_col, end_col)
+ *   refresh_start(dirty cells), refresh_end(cells, held back)
+ *   key(ch), resize(rows, cols)
+ */
+#ifdef NCTE_USDT
+#	include <sys/sdt.h>
+#	define TRACE0(_name) DTRACE_PROBE(ncte, _name)
+#	define TRACE1(_name, _a) DTRACE_PROBE1(ncte, _name, _a)
+#	define TRACE2(_name, _a, _b) DTRACE_PROBE2(ncte, _name, _a, _b)
+#	define TRACE4(_name, _a, _b, _c, _d) DTRACE_PROBE4(ncte, _name, _a, _b, _c, _d)
+#else
+#	define TRACE0(_name) do {} while(0)
+#	define TRACE1(_name, _a) do {} while(0)
+#	define TRACE2(_name, _a, _b) do {} while(0)
+#	define TRACE4(_name, _a, _b, _c, _d) do {} while(0)
+#endif
+
+#endif /* NCTE_TRACE_H */
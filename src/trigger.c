@@ -0,0 +1,303 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* watches the pty output for a set of patterns and 
+ * alerts the user when one goes by. all patterns are
+ * matched in one pass with an aho-corasick automaton,
+ * built as a full transition table so each byte costs
+ * one lookup. the state is kept between reads, so a 
+ * match split across reads is still found. the raw 
+ * output is scanned, so a pattern interrupted by an 
+ * escape sequence (e.g. a color change) wont match.
+ */
+
+#include "trigger.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "timer.h"
+#include "log.h"
+#include "screen.h"
+
+#define TRIGGER_MAX 256
+#define TRIGGER_ALERT_USEC 500000 /* at most one bell or flash per this many usec */
+
+static struct {
+	char *patterns[TRIGGER_MAX];
+	unsigned long matches[TRIGGER_MAX];
+	int npatterns;
+	int action;
+	int *delta; /* next state, 256 entries per state */
+	int *out; /* pattern ending at each state, or -1 */
+	int *dict; /* nearest proper suffix state with an output, or 0 */
+	int nstates;
+	unsigned char first[256]; /* bytes that leave the root state */
+	int nfirst;
+	unsigned char first_byte; /* the only such byte if nfirst is 1 */
+	int state;
+	int alerted;
+	struct timer_t alert;
+} g_trigger;
+
+static const char *const action_names[] = {
+	"log", "bell", "flash"
+};
+
+int trigger_action_parse(const char *name) {
+	int i;
+
+	for(i = 0; i <= TRIGGER_FLASH; i++) 
+		if(strcasecmp(name, action_names[i]) == 0)
+			return i;
+
+	return -1;
+}
+
+int trigger_add(const char *pattern) {
+	if(pattern[0] == '\0') {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if(g_trigger.npatterns >= TRIGGER_MAX) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	if( (g_trigger.patterns[g_trigger.npatterns] = strdup(pattern)) == NULL)
+		return -1;
+
+	g_trigger.npatterns++;
+	return 0;
+}
+
+/* adds one pattern per line of path. empty lines 
+ * are skipped. */
+int trigger_load(const char *path) {
+	FILE *fp;
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+	int status = 0;
+
+	if( (fp = fopen(path, "r")) == NULL)
+		return -1;
+
+	while(status == 0 && (len = getline(&line, &size, fp)) >= 0) {
+		if(len > 0 && line[len-1] == '\n')
+			line[--len] = '\0';
+		if(len > 0)
+			status = trigger_add(line);
+	}
+
+	free(line);
+	fclose(fp);
+	return status;
+}
+
+static int add_state() {
+	int state = g_trigger.nstates++;
+
+	memset(&g_trigger.delta[state*256], 0, 256*sizeof(int));
+	g_trigger.out[state] = -1;
+	g_trigger.dict[state] = 0;
+	return state;
+}
+
+/* state 0 is the root. in the trie a transition to 0
+ * means there is no edge, since nothing leads back 
+ * to the root. 
+ */
+static void build_trie() {
+	const unsigned char *p;
+	int i, state, *next;
+
+	add_state();
+	for(i = 0; i < g_trigger.npatterns; i++) {
+		state = 0;
+		for(p = (const unsigned char *) g_trigger.patterns[i]; *p != '\0'; p++) {
+			next = &g_trigger.delta[state*256 + *p];
+			if(*next == 0)
+				*next = add_state();
+			state = *next;
+		}
+
+		/* a duplicate pattern only counts once */
+		if(g_trigger.out[state] < 0)
+			g_trigger.out[state] = i;
+	}
+}
+
+/* turn the trie into the full automaton, visiting
+ * states in breadth first order so each failure state
+ * is finished before it is used.
+ */
+static int build_links() {
+	int *queue, *fail, head, tail, state, child, c;
+
+	queue = malloc(sizeof(int)*g_trigger.nstates);
+	fail = malloc(sizeof(int)*g_trigger.nstates);
+	if(queue == NULL || fail == NULL) {
+		free(queue);
+		free(fail);
+		return -1;
+	}
+
+	head = tail = 0;
+	for(c = 0; c < 256; c++) {
+		if( (child = g_trigger.delta[c]) == 0)
+			continue;
+
+		fail[child] = 0;
+		queue[tail++] = child;
+		g_trigger.first[c] = 1;
+		g_trigger.first_byte = c;
+		g_trigger.nfirst++;
+	}
+
+	while(head < tail) {
+		state = queue[head++];
+		for(c = 0; c < 256; c++) {
+			child = g_trigger.delta[state*256 + c];
+			if(child == 0) {
+				g_trigger.delta[state*256 + c] = g_trigger.delta[fail[state]*256 + c];
+				continue;
+			}
+
+			fail[child] = g_trigger.delta[fail[state]*256 + c];
+			g_trigger.dict[child] = (g_trigger.out[fail[child]] >= 0)? fail[child] : g_trigger.dict[fail[child]];
+			queue[tail++] = child;
+		}
+	}
+
+	free(queue);
+	free(fail);
+	return 0;
+}
+
+/* call after all patterns are added. does nothing
+ * if there are no patterns. */
+int trigger_build(int action) {
+	int i, max_states;
+
+	g_trigger.action = action;
+	if(g_trigger.npatterns == 0)
+		return 0;
+
+	for(i = 0, max_states = 1; i < g_trigger.npatterns; i++)
+		max_states += strlen(g_trigger.patterns[i]);
+
+	g_trigger.delta = malloc(sizeof(int)*256*max_states);
+	g_trigger.out = malloc(sizeof(int)*max_states);
+	g_trigger.dict = malloc(sizeof(int)*max_states);
+	if(g_trigger.delta == NULL || g_trigger.out == NULL || g_trigger.dict == NULL)
+		return -1;
+
+	build_trie();
+	if(build_links() != 0)
+		return -1;
+
+	LOGF_INFO("triggers: %d patterns, %d states\n", g_trigger.npatterns, g_trigger.nstates);
+	return 0;
+}
+
+static void alert() {
+	if(g_trigger.action == TRIGGER_LOG)
+		return;
+
+	if(g_trigger.alerted && timer_thresh(&g_trigger.alert, 0, TRIGGER_ALERT_USEC) == 0)
+		return;
+
+	screen_alert(g_trigger.action == TRIGGER_FLASH);
+	timer_init(&g_trigger.alert);
+	g_trigger.alerted = 1;
+}
+
+static int report(int state) {
+	int n;
+
+	if(g_trigger.out[state] < 0)
+		state = g_trigger.dict[state];
+
+	for(n = 0; state != 0; state = g_trigger.dict[state], n++) {
+		g_trigger.matches[g_trigger.out[state]]++;
+		LOGF_INFO("trigger %d matched\n", g_trigger.out[state]);
+	}
+
+	return n;
+}
+
+/* returns the number of matches in buf */
+int trigger_scan(const char *buf, size_t len) {
+	const unsigned char *p = (const unsigned char *) buf;
+	const unsigned char *end = p + len;
+	int state, found;
+
+	if(g_trigger.nstates == 0)
+		return 0;
+
+	state = g_trigger.state;
+	found = 0;
+	while(p < end) {
+		/* most output never leaves the root, so skip 
+		 * ahead to the next byte that can start a match */
+		if(state == 0) {
+			if(g_trigger.nfirst == 1) {
+				if( (p = memchr(p, g_trigger.first_byte, end - p)) == NULL)
+					break;
+			}
+			else {
+				while(p < end && !g_trigger.first[*p])
+					p++;
+				if(p == end)
+					break;
+			}
+		}
+
+		state = g_trigger.delta[state*256 + *p++];
+		if(g_trigger.out[state] >= 0 || g_trigger.dict[state] != 0)
+			found += report(state);
+	}
+
+	g_trigger.state = state;
+	if(found > 0)
+		alert();
+
+	return found;
+}
+
+void trigger_report(FILE *fp) {
+	int i;
+
+	for(i = 0; i < g_trigger.npatterns; i++)
+		fprintf(fp, "trigger %d '%s': %lu matches\n", i, g_trigger.patterns[i], g_trigger.matches[i]);
+}
+
+void trigger_free() {
+	int i;
+
+	for(i = 0; i < g_trigger.npatterns; i++)
+		free(g_trigger.patterns[i]);
+	free(g_trigger.delta);
+	free(g_trigger.out);
+	free(g_trigger.dict);
+	memset(&g_trigger, 0, sizeof(g_trigger));
+}
@@ -0,0 +1,40 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef NCTE_TRIGGER_H
+#define NCTE_TRIGGER_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+enum trigger_action {
+	TRIGGER_LOG = 0, /* only log the match */
+	TRIGGER_BELL,
+	TRIGGER_FLASH /* visual bell */
+};
+
+int trigger_action_parse(const char *name);
+int trigger_add(const char *pattern);
+int trigger_load(const char *path);
+int trigger_build(int action);
+int trigger_scan(const char *buf, size_t len);
+void trigger_report(FILE *fp);
+void trigger_free();
+
+#endif /* NCTE_TRIGGER_H */
@@ -0,0 +1,498 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* an io_uring replacement for select and pty_read. the 
+ * master pty is read through the ring into a registered
+ * buffer, behind a linked poll so the non-blocking read
+ * only runs once there is output, and the other fds are
+ * polled through the ring. waiting, reading and polling
+ * then share one io_uring_enter per wake up instead of
+ * a select plus a read per chunk. writes still go 
+ * straight to the fds: the pty only gets keystrokes and
+ * curses writes to the tty itself.
+ *
+ * the ring is set up with raw syscalls, so liburing 
+ * isnt needed. uring_init fails with ENOSYS where the
+ * kernel (or a seccomp filter) doesnt allow io_uring
+ * and the caller keeps using select.
+ */
+
+#include "uring.h"
+#include <errno.h>
+
+#if defined(__linux__) && defined(__has_include)
+#	if __has_include(<linux/io_uring.h>)
+#		define URING_SUPPORTED
+#	endif
+#endif
+
+#ifdef URING_SUPPORTED
+
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "log.h"
+
+#define URING_ENTRIES 16
+#define URING_POLLS_MAX 8
+
+enum uring_data {
+	URING_DATA_READ = 1,
+	URING_DATA_READ_POLL, /* the poll linked in front of the read */
+	URING_DATA_TIMEOUT,
+	URING_DATA_POLLS /* + the index of the poll */
+};
+
+struct uring_poll {
+	int fd;
+	short events;
+	int pending; /* submitted, not completed */
+	int ready;
+};
+
+static struct {
+	int fd; /* -1 until uring_init succeeds */
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_size, cq_ring_size;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	unsigned tail; /* our copy of the sq tail, ahead of it until submit */
+	unsigned queued; /* sqes not yet consumed by the kernel */
+	struct __kernel_timespec ts;
+	int timed_out;
+
+	int master;
+	char *buf; /* registered buffer the master is read into */
+	size_t size;
+	int read_pending, read_ready;
+	int read_res; /* bytes read or -errno */
+	size_t read_off; /* bytes of the chunk already handed out */
+
+	struct uring_poll polls[URING_POLLS_MAX];
+	int npolls;
+} g_uring = {
+	.fd = -1
+};
+
+static int sys_setup(unsigned entries, struct io_uring_params *p) {
+	return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+	return (int) syscall(__NR_io_uring_enter, g_uring.fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_register(unsigned opcode, void *arg, unsigned nr_args) {
+	return (int) syscall(__NR_io_uring_register, g_uring.fd, opcode, arg, nr_args);
+}
+
+/* the kernel has to support every op we use */
+static int probe_ops() {
+	static const int needed[] = {IORING_OP_POLL_ADD, IORING_OP_READ_FIXED, IORING_OP_TIMEOUT};
+	struct io_uring_probe *probe;
+	size_t i;
+	int status = 0;
+
+	if( (probe = calloc(1, sizeof(*probe) + 256*sizeof(struct io_uring_probe_op))) == NULL)
+		return -1;
+
+	if(sys_register(IORING_REGISTER_PROBE, probe, 256) != 0)
+		status = -1;
+	for(i = 0; status == 0 && i < sizeof(needed)/sizeof(int); i++) {
+		if(needed[i] > probe->last_op || !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED) ) {
+			errno = ENOSYS;
+			status = -1;
+		}
+	}
+
+	free(probe);
+	return status;
+}
+
+static int map_rings(const struct io_uring_params *p) {
+	g_uring.sq_ring_size = p->sq_off.array + p->sq_entries*sizeof(unsigned);
+	g_uring.cq_ring_size = p->cq_off.cqes + p->cq_entries*sizeof(struct io_uring_cqe);
+	if(p->features & IORING_FEAT_SINGLE_MMAP) {
+		if(g_uring.cq_ring_size > g_uring.sq_ring_size)
+			g_uring.sq_ring_size = g_uring.cq_ring_size;
+		g_uring.cq_ring_size = 0;
+	}
+
+	g_uring.sq_ring = mmap(NULL, g_uring.sq_ring_size, PROT_READ | PROT_WRITE, 
+		MAP_SHARED | MAP_POPULATE, g_uring.fd, IORING_OFF_SQ_RING);
+	if(g_uring.sq_ring == MAP_FAILED)
+		return -1;
+
+	if(g_uring.cq_ring_size == 0)
+		g_uring.cq_ring = g_uring.sq_ring;
+	else {
+		g_uring.cq_ring = mmap(NULL, g_uring.cq_ring_size, PROT_READ | PROT_WRITE, 
+			MAP_SHARED | MAP_POPULATE, g_uring.fd, IORING_OFF_CQ_RING);
+		if(g_uring.cq_ring == MAP_FAILED)
+			return -1;
+	}
+
+	g_uring.sqes = mmap(NULL, p->sq_entries*sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, g_uring.fd, IORING_OFF_SQES);
+	if(g_uring.sqes == MAP_FAILED)
+		return -1;
+
+	g_uring.sq_head = (unsigned *) ((char *) g_uring.sq_ring + p->sq_off.head);
+	g_uring.sq_tail = (unsigned *) ((char *) g_uring.sq_ring + p->sq_off.tail);
+	g_uring.sq_mask = (unsigned *) ((char *) g_uring.sq_ring + p->sq_off.ring_mask);
+	g_uring.sq_array = (unsigned *) ((char *) g_uring.sq_ring + p->sq_off.array);
+	g_uring.cq_head = (unsigned *) ((char *) g_uring.cq_ring + p->cq_off.head);
+	g_uring.cq_tail = (unsigned *) ((char *) g_uring.cq_ring + p->cq_off.tail);
+	g_uring.cq_mask = (unsigned *) ((char *) g_uring.cq_ring + p->cq_off.ring_mask);
+	g_uring.cqes = (struct io_uring_cqe *) ((char *) g_uring.cq_ring + p->cq_off.cqes);
+	return 0;
+}
+
+/* returns -1 with errno set if io_uring cant be used */
+int uring_init(int master, size_t size) {
+	struct io_uring_params p;
+	struct iovec iov;
+
+	memset(&p, 0, sizeof(p));
+	if( (g_uring.fd = sys_setup(URING_ENTRIES, &p)) < 0)
+		return -1;
+
+	g_uring.sq_ring = g_uring.cq_ring = g_uring.sqes = MAP_FAILED;
+	if(probe_ops() != 0 || map_rings(&p) != 0)
+		goto fail;
+
+	if( (g_uring.buf = malloc(size)) == NULL)
+		goto fail;
+	iov.iov_base = g_uring.buf;
+	iov.iov_len = size;
+	if(sys_register(IORING_REGISTER_BUFFERS, &iov, 1) != 0)
+		goto fail;
+
+	g_uring.size = size;
+	g_uring.master = master;
+	g_uring.tail = *g_uring.sq_tail;
+	LOGF_INFO("io_uring: %d entries, features 0x%x\n", (int) p.sq_entries, (int) p.features);
+	return 0;
+
+fail:
+	uring_free();
+	return -1;
+}
+
+void uring_free() {
+	int saved_errno = errno;
+
+	if(g_uring.sqes != NULL && g_uring.sqes != MAP_FAILED)
+		munmap(g_uring.sqes, URING_ENTRIES*sizeof(struct io_uring_sqe));
+	if(g_uring.cq_ring != NULL && g_uring.cq_ring != MAP_FAILED && g_uring.cq_ring != g_uring.sq_ring)
+		munmap(g_uring.cq_ring, g_uring.cq_ring_size);
+	if(g_uring.sq_ring != NULL && g_uring.sq_ring != MAP_FAILED)
+		munmap(g_uring.sq_ring, g_uring.sq_ring_size);
+	if(g_uring.fd >= 0)
+		close(g_uring.fd);
+
+	free(g_uring.buf);
+	memset(&g_uring, 0, sizeof(g_uring));
+	g_uring.fd = -1;
+	errno = saved_errno;
+}
+
+/* never fails: at most URING_POLLS_MAX + 3 sqes are in
+ * flight, and the ring has room for more */
+static struct io_uring_sqe *get_sqe() {
+	struct io_uring_sqe *sqe;
+	unsigned tail;
+
+	tail = g_uring.tail++;
+	g_uring.sq_array[tail & *g_uring.sq_mask] = tail & *g_uring.sq_mask;
+	sqe = &g_uring.sqes[tail & *g_uring.sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	g_uring.queued++;
+	return sqe;
+}
+
+static void arm_read() {
+	struct io_uring_sqe *sqe;
+
+	sqe = get_sqe();
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = g_uring.master;
+	sqe->poll_events = POLLIN;
+	sqe->flags = IOSQE_IO_LINK;
+	sqe->user_data = URING_DATA_READ_POLL;
+
+	sqe = get_sqe();
+	sqe->opcode = IORING_OP_READ_FIXED;
+	sqe->fd = g_uring.master;
+	sqe->addr = (unsigned long) g_uring.buf;
+	sqe->len = g_uring.size;
+	sqe->buf_index = 0;
+	sqe->user_data = URING_DATA_READ;
+
+	g_uring.read_pending = 1;
+}
+
+static void arm_poll(int fd, short events) {
+	struct io_uring_sqe *sqe;
+	struct uring_poll *poll;
+	int i;
+
+	for(i = 0; i < g_uring.npolls; i++)
+		if(g_uring.polls[i].fd == fd && g_uring.polls[i].events == events)
+			break;
+
+	if(i == g_uring.npolls) {
+		if(g_uring.npolls >= URING_POLLS_MAX)
+			return;
+		g_uring.polls[g_uring.npolls++] = (struct uring_poll) {.fd = fd, .events = events};
+	}
+
+	poll = &g_uring.polls[i];
+	if(poll->pending || poll->ready)
+		return;
+
+	sqe = get_sqe();
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll_events = events;
+	sqe->user_data = URING_DATA_POLLS + i;
+	poll->pending = 1;
+}
+
+/* complete after usec or after the next completion, 
+ * whichever comes first */
+static void arm_timeout(const struct timeval *timeout) {
+	struct io_uring_sqe *sqe;
+
+	g_uring.ts.tv_sec = timeout->tv_sec;
+	g_uring.ts.tv_nsec = timeout->tv_usec*1000L;
+	sqe = get_sqe();
+	sqe->opcode = IORING_OP_TIMEOUT;
+	sqe->addr = (unsigned long) &g_uring.ts;
+	sqe->len = 1;
+	sqe->off = 1;
+	sqe->user_data = URING_DATA_TIMEOUT;
+}
+
+/* hand the queued sqes to the kernel without waiting */
+static int submit() {
+	int n;
+
+	if(g_uring.queued == 0)
+		return 0;
+
+	__atomic_store_n(g_uring.sq_tail, g_uring.tail, __ATOMIC_RELEASE);
+	if( (n = sys_enter(g_uring.queued, 0, 0)) < 0)
+		return -1;
+
+	g_uring.queued -= n;
+	return 0;
+}
+
+/* block until there is a completion. this is kept 
+ * apart from submit: an enter that submits anything 
+ * returns the count even if a signal cut its wait 
+ * short, which would hide the EINTR from the caller.
+ */
+static int wait_cqe() {
+	if(*g_uring.cq_head != __atomic_load_n(g_uring.cq_tail, __ATOMIC_ACQUIRE) )
+		return 0;
+
+	return (sys_enter(0, 1, IORING_ENTER_GETEVENTS) < 0)? -1 : 0;
+}
+
+static void reap() {
+	struct io_uring_cqe *cqe;
+	unsigned head, tail;
+	int i;
+
+	head = *g_uring.cq_head;
+	tail = __atomic_load_n(g_uring.cq_tail, __ATOMIC_ACQUIRE);
+	for(; head != tail; head++) {
+		cqe = &g_uring.cqes[head & *g_uring.cq_mask];
+		switch(cqe->user_data) {
+		case URING_DATA_READ:
+			g_uring.read_pending = 0;
+			g_uring.read_ready = 1;
+			g_uring.read_res = cqe->res;
+			g_uring.read_off = 0;
+			break;
+		case URING_DATA_READ_POLL:
+			break;
+		case URING_DATA_TIMEOUT:
+			if(cqe->res == -ETIME)
+				g_uring.timed_out = 1;
+			break;
+		default:
+			i = cqe->user_data - URING_DATA_POLLS;
+			if(i >= 0 && i < g_uring.npolls) {
+				g_uring.polls[i].pending = 0;
+				g_uring.polls[i].ready = 1;
+			}
+		}
+	}
+
+	__atomic_store_n(g_uring.cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* fills in the sets like select with what has 
+ * completed out of what was asked for, without 
+ * reporting a poll twice */
+static int collect(int nfds, const fd_set *want_in, const fd_set *want_out, 
+		fd_set *in_fds, fd_set *out_fds) {
+	fd_set in, out;
+	int fd, i, n;
+
+	FD_ZERO(&in);
+	FD_ZERO(&out);
+	n = 0;
+	if(g_uring.read_ready && FD_ISSET(g_uring.master, want_in) ) {
+		FD_SET(g_uring.master, &in);
+		n++;
+	}
+
+	for(i = 0; i < g_uring.npolls; i++) {
+		fd = g_uring.polls[i].fd;
+		if(!g_uring.polls[i].ready || fd >= nfds)
+			continue;
+
+		if(g_uring.polls[i].events == POLLIN && FD_ISSET(fd, want_in) ) 
+			FD_SET(fd, &in);
+		else if(g_uring.polls[i].events == POLLOUT && FD_ISSET(fd, want_out) )
+			FD_SET(fd, &out);
+		else
+			continue;
+
+		g_uring.polls[i].ready = 0;
+		n++;
+	}
+
+	*in_fds = in;
+	*out_fds = out;
+	return n;
+}
+
+/* the same contract as select, minus the except set */
+int uring_wait(int nfds, fd_set *in_fds, fd_set *out_fds, struct timeval *timeout) {
+	fd_set want_in, want_out;
+	int fd, n;
+
+	for(fd = 0; fd < nfds; fd++) {
+		if(FD_ISSET(fd, in_fds) ) {
+			if(fd == g_uring.master) {
+				if(!g_uring.read_pending && !g_uring.read_ready)
+					arm_read();
+			}
+			else
+				arm_poll(fd, POLLIN);
+		}
+
+		if(FD_ISSET(fd, out_fds) )
+			arm_poll(fd, POLLOUT);
+	}
+
+	want_in = *in_fds;
+	want_out = *out_fds;
+	reap();
+	if( (n = collect(nfds, &want_in, &want_out, in_fds, out_fds)) > 0)
+		return (submit() != 0)? -1 : n;
+
+	g_uring.timed_out = 0;
+	if(timeout != NULL)
+		arm_timeout(timeout);
+
+	/* the poll half of the read completes on its own, 
+	 * so keep waiting until something is reportable */
+	while(1) {
+		if(submit() != 0 || wait_cqe() != 0)
+			return -1;
+
+		reap();
+		if( (n = collect(nfds, &want_in, &want_out, in_fds, out_fds)) > 0 || g_uring.timed_out)
+			return n;
+	}
+}
+
+/* a chunk bigger than size is handed out over several 
+ * calls, and the master stays ready until it is gone */
+ssize_t uring_read(int fd, char *buf, size_t size) {
+	size_t n;
+
+	if(fd != g_uring.master || !g_uring.read_ready)
+		return 0;
+
+	if(g_uring.read_res < 0) {
+		g_uring.read_ready = 0;
+		errno = -g_uring.read_res;
+		return (errno == EAGAIN)? 0 : -1;
+	}
+	else if(g_uring.read_res == 0) {
+		g_uring.read_ready = 0;
+		errno = EIO;
+		return -1;
+	}
+
+	n = (size_t) g_uring.read_res - g_uring.read_off;
+	if(n > size)
+		n = size;
+	memcpy(buf, g_uring.buf + g_uring.read_off, n);
+	g_uring.read_off += n;
+	if(g_uring.read_off == (size_t) g_uring.read_res)
+		g_uring.read_ready = 0;
+
+	return n;
+}
+
+#else /* URING_SUPPORTED */
+
+int uring_init(int master, size_t size) {
+	(void)(master);
+	(void)(size);
+	errno = ENOSYS;
+	return -1;
+}
+
+void uring_free() {}
+
+int uring_wait(int nfds, fd_set *in_fds, fd_set *out_fds, struct timeval *timeout) {
+	(void)(nfds);
+	(void)(in_fds);
+	(void)(out_fds);
+	(void)(timeout);
+	errno = ENOSYS;
+	return -1;
+}
+
+ssize_t uring_read(int fd, char *buf, size_t size) {
+	(void)(fd);
+	(void)(buf);
+	(void)(size);
+	errno = ENOSYS;
+	return -1;
+}
+
+#endif /* URING_SUPPORTED */
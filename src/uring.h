@@ -0,0 +1,33 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef NCTE_URING_H
+#define NCTE_URING_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/select.h>
+#include <sys/time.h>
+
+int uring_init(int master, size_t size);
+void uring_free();
+int uring_wait(int nfds, fd_set *in_fds, fd_set *out_fds, struct timeval *timeout);
+ssize_t uring_read(int fd, char *buf, size_t size);
+
+#endif /* NCTE_URING_H */
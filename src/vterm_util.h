@@ -35,4 +35,19 @@ static inline int vterm_color_dist_sq(const VTermColor *x, const VTermColor *y)
 	return r*r + g*g + b*b;
 }
 
+/* "redmean" weighted distance: a cheap approximation
+ * of perceived difference that weighs red and blue
+ * by how bright the red component is.
+ */
+static inline int vterm_color_dist_perceptual(const VTermColor *x, const VTermColor *y) {
+	int rmean, r, g, b;
+
+	rmean = (x->red + y->red)/2;
+	r = (x->red - y->red);
+	g = (x->green - y->green);
+	b = (x->blue - y->blue);
+
+	return (((512 + rmean)*r*r) >> 8) + 4*g*g + (((767 - rmean)*b*b) >> 8);
+}
+
 #endif /* NCTE_VTERM_UTIL */
\ No newline at end of file
@@ -0,0 +1,161 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* a fixed pool of threads for splitting a batch of
+ * independent items. the calling thread works on the
+ * batch too, and workers_run returns once every worker
+ * has seen the batch, so a worker never picks up items
+ * from a batch other than the one it was woken for.
+ */
+
+#include "workers.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+
+static struct {
+	pthread_t threads[WORKERS_MAX];
+	int n;
+	pthread_mutex_t lock;
+	pthread_cond_t work, done;
+	unsigned long gen; /* incremented for every batch */
+	int finished; /* workers done with the current batch */
+	int stop;
+	workers_fn fn;
+	void *arg;
+	int nitems;
+	int next; /* next unclaimed item */
+} g_workers = {
+	.n = 0,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER
+};
+
+static void run_items(workers_fn fn, void *arg, int nitems) {
+	int item;
+
+	while( (item = __sync_fetch_and_add(&g_workers.next, 1)) < nitems)
+		(*fn)(arg, item);
+}
+
+static void *worker_main(void *unused) {
+	unsigned long seen = 0;
+	workers_fn fn;
+	void *arg;
+	int nitems;
+	(void)(unused);
+
+	pthread_mutex_lock(&g_workers.lock);
+	while(1) {
+		while(g_workers.gen == seen && !g_workers.stop)
+			pthread_cond_wait(&g_workers.work, &g_workers.lock);
+		if(g_workers.stop)
+			break;
+
+		seen = g_workers.gen;
+		fn = g_workers.fn;
+		arg = g_workers.arg;
+		nitems = g_workers.nitems;
+		pthread_mutex_unlock(&g_workers.lock);
+
+		run_items(fn, arg, nitems);
+
+		pthread_mutex_lock(&g_workers.lock);
+		if(++g_workers.finished == g_workers.n)
+			pthread_cond_signal(&g_workers.done);
+	}
+	pthread_mutex_unlock(&g_workers.lock);
+
+	return NULL;
+}
+
+/* start n worker threads. signals are blocked in the 
+ * workers so SIGWINCH and friends are still delivered 
+ * to the main loop. returns -1 with errno set on error.
+ */
+int workers_start(int n) {
+	sigset_t all, prev;
+	int i, error;
+
+	if(n < 0 || n > WORKERS_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &prev);
+	for(i = 0; i < n; i++) {
+		if( (error = pthread_create(&g_workers.threads[i], NULL, worker_main, NULL)) != 0)
+			break;
+		g_workers.n++;
+	}
+	pthread_sigmask(SIG_SETMASK, &prev, NULL);
+
+	if(i < n) {
+		workers_stop();
+		errno = error;
+		return -1;
+	}
+
+	return 0;
+}
+
+int workers_count() {
+	return g_workers.n;
+}
+
+void workers_run(workers_fn fn, void *arg, int nitems) {
+	if(g_workers.n == 0) {
+		g_workers.next = 0;
+		run_items(fn, arg, nitems);
+		return;
+	}
+
+	pthread_mutex_lock(&g_workers.lock);
+	g_workers.fn = fn;
+	g_workers.arg = arg;
+	g_workers.nitems = nitems;
+	g_workers.next = 0;
+	g_workers.finished = 0;
+	g_workers.gen++;
+	pthread_cond_broadcast(&g_workers.work);
+	pthread_mutex_unlock(&g_workers.lock);
+
+	run_items(fn, arg, nitems);
+
+	pthread_mutex_lock(&g_workers.lock);
+	while(g_workers.finished < g_workers.n)
+		pthread_cond_wait(&g_workers.done, &g_workers.lock);
+	pthread_mutex_unlock(&g_workers.lock);
+}
+
+void workers_stop() {
+	int i;
+
+	pthread_mutex_lock(&g_workers.lock);
+	g_workers.stop = 1;
+	pthread_cond_broadcast(&g_workers.work);
+	pthread_mutex_unlock(&g_workers.lock);
+
+	for(i = 0; i < g_workers.n; i++)
+		pthread_join(g_workers.threads[i], NULL);
+
+	g_workers.n = 0;
+	g_workers.stop = 0;
+}
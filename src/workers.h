@@ -0,0 +1,32 @@
+/* 
+ * Copyright 2012 anthony cantor
+ * This file is part of ncte.
+ *
+ * ncte is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ncte is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ncte.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NCTE_WORKERS_H
+#define NCTE_WORKERS_H
+
+#define WORKERS_MAX 16
+
+/* called once for every item in [0, nitems) */
+typedef void (*workers_fn)(void *arg, int item);
+
+int workers_start(int n);
+int workers_count();
+void workers_run(workers_fn fn, void *arg, int nitems);
+void workers_stop();
+
+#endif /* NCTE_WORKERS_H */
@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/time.h>
+
+#include "vterm.h"
+#include "loop.h"
+#include "timer.h"
+#include "pty.h"
+#include "predict.h"
+#include "err.h"
+
+/* drives loop() with a virtual clock and a fake child on
+ * the other end of a socketpair. time only moves when
+ * the loop waits for I/O, so refresh times are exact.
+ */
+
+#define MAX_REFRESHES 64
+#define MAX_EVENTS 1024
+#define EPOCH 1000000 /* virtual seconds at time 0 */
+
+enum event_type {
+	EV_OUTPUT = 0, /* the child writes data */
+	EV_KEY, /* the user types data */
+	EV_CLOSE /* the child exits */
+};
+
+struct event {
+	long at; /* usec of virtual time */
+	int type;
+	const char *data;
+};
+
+static struct {
+	long now; /* usec since EPOCH */
+	struct event script[MAX_EVENTS];
+	int nevents, next;
+	int child; /* the fake child's end of the socketpair */
+	int keys[2]; /* pipe the fake user types into */
+	long refreshes[MAX_REFRESHES];
+	int nrefreshes;
+	char received[256]; /* what the child read from the loop */
+	size_t nreceived;
+	int predict; /* predict_mode for the next run */
+	int drawn; /* most predictions seen on the screen */
+} t;
+
+static int virtual_clock(struct timeval *now) {
+	now->tv_sec = EPOCH + t.now/1000000;
+	now->tv_usec = t.now%1000000;
+	return 0;
+}
+
+static void add_event(long at, int type, const char *data) {
+	if(t.nevents >= MAX_EVENTS)
+		err_exit(0, "too many events");
+
+	t.script[t.nevents].at = at;
+	t.script[t.nevents].type = type;
+	t.script[t.nevents].data = data;
+	t.nevents++;
+}
+
+static void child_read() {
+	ssize_t n;
+
+	n = read(t.child, t.received + t.nreceived, sizeof(t.received) - t.nreceived - 1);
+	if(n > 0)
+		t.nreceived += n;
+	t.received[t.nreceived] = '\0';
+}
+
+static void run_event(const struct event *ev) {
+	int fd;
+
+	child_read();
+	if(predict_drawn() > t.drawn)
+		t.drawn = predict_drawn();
+
+	switch(ev->type) {
+	case EV_OUTPUT:
+	case EV_KEY:
+		fd = (ev->type == EV_OUTPUT)? t.child : t.keys[1];
+		if(write(fd, ev->data, strlen(ev->data)) != (ssize_t) strlen(ev->data))
+			err_exit(errno, "fake write");
+		break;
+	case EV_CLOSE:
+		close(t.child);
+		t.child = -1;
+		break;
+	}
+}
+
+static int poll_now(int nfds, fd_set *in_fds, fd_set *out_fds) {
+	struct timeval zero = {0, 0};
+	fd_set in, out;
+	int n;
+
+	in = *in_fds;
+	out = *out_fds;
+	if( (n = select(nfds, &in, &out, NULL, &zero)) > 0) {
+		*in_fds = in;
+		*out_fds = out;
+	}
+
+	return n;
+}
+
+/* returns whatever is ready now. otherwise runs the
+ * script up to the next event that makes something
+ * ready, or lets the timeout pass if that comes first.
+ */
+static int fake_wait(int nfds, fd_set *in_fds, fd_set *out_fds, struct timeval *timeout) {
+	long deadline;
+	int n;
+
+	deadline = (timeout == NULL)? -1 : t.now + timeout->tv_sec*1000000 + timeout->tv_usec;
+	while( (n = poll_now(nfds, in_fds, out_fds)) == 0) {
+		if(t.next >= t.nevents || (deadline >= 0 && deadline < t.script[t.next].at) ) {
+			if(deadline < 0)
+				err_exit(0, "loop would wait forever at %ld", t.now);
+
+			t.now = deadline;
+			FD_ZERO(in_fds);
+			FD_ZERO(out_fds);
+			return 0;
+		}
+
+		if(t.script[t.next].at > t.now)
+			t.now = t.script[t.next].at;
+		run_event(&t.script[t.next++]);
+	}
+
+	return n;
+}
+
+static int fake_getch(int *ch) {
+	unsigned char c;
+
+	if(read(t.keys[0], &c, 1) != 1)
+		return -1;
+
+	*ch = c;
+	return 0;
+}
+
+static int fake_refresh() {
+	if(t.nrefreshes >= MAX_REFRESHES)
+		err_exit(0, "too many refreshes");
+
+	t.refreshes[t.nrefreshes++] = t.now;
+	return 0;
+}
+
+/* runs the events added since the last call through a
+ * fresh loop.
+ */
+static void run() {
+	struct loop_io io;
+	int fds[2];
+	VTerm *vt;
+
+	if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0 || pipe(t.keys) != 0)
+		err_exit(errno, "socketpair");
+	if(fcntl(fds[0], F_SETFL, O_NONBLOCK) != 0 || fcntl(fds[1], F_SETFL, O_NONBLOCK) != 0
+			|| fcntl(t.keys[0], F_SETFL, O_NONBLOCK) != 0)
+		err_exit(errno, "fcntl");
+
+	t.now = 0;
+	t.next = 0;
+	t.nrefreshes = 0;
+	t.nreceived = 0;
+	t.received[0] = '\0';
+	t.drawn = 0;
+	t.child = fds[1];
+
+	vt = vterm_new(24, 80);
+	vterm_screen_reset(vterm_obtain_screen(vt), 1);
+	predict_init(vt, t.predict);
+
+	io.master = fds[0];
+	io.input = t.keys[0];
+	io.wait = fake_wait;
+	io.read = pty_read;
+	io.getch = fake_getch;
+	io.refresh = fake_refresh;
+	loop(vt, &io);
+
+	predict_init(NULL, PREDICT_NEVER);
+	vterm_free(vt);
+	close(fds[0]);
+	close(t.keys[0]);
+	close(t.keys[1]);
+	t.nevents = 0;
+}
+
+static int expect_refreshes(const char *name, const long *expected, int n) {
+	int i, ok;
+
+	ok = (n == t.nrefreshes);
+	for(i = 0; ok && i < n; i++)
+		ok = (expected[i] == t.refreshes[i]);
+
+	printf("%s: %s\n", ok? "ok" : "FAIL", name);
+	if(!ok) {
+		printf("\trefreshed at:");
+		for(i = 0; i < t.nrefreshes; i++)
+			printf(" %ld", t.refreshes[i]);
+		printf("\n\texpected:");
+		for(i = 0; i < n; i++)
+			printf(" %ld", expected[i]);
+		printf("\n");
+	}
+
+	return !ok;
+}
+
+int main() {
+	static const long single[] = {10000};
+	static const long burst[] = {300000, 600000, 900000, 1008000};
+	static const long echo[] = {10000, 100000, 120000};
+	static const long busy_echo[] = {7000, 9000};
+	static const long sync_echo[] = {10000, 50000};
+	long at;
+	int failed;
+
+	if(loop_init(1024) != 0)
+		err_exit(errno, "loop_init");
+	timer_set_clock(virtual_clock);
+	failed = 0;
+
+	/* a single write is drawn once output has been
+	 * quiet for 10ms */
+	add_event(0, EV_OUTPUT, "hello");
+	add_event(1000000, EV_CLOSE, NULL);
+	run();
+	failed += expect_refreshes("single write", single, sizeof(single)/sizeof(long));
+
+	/* a steady burst is still drawn every 300ms */
+	for(at = 0; at < 1000000; at += 2000)
+		add_event(at, EV_OUTPUT, "0123456789\r\n");
+	add_event(2000000, EV_CLOSE, NULL);
+	run();
+	failed += expect_refreshes("burst", burst, sizeof(burst)/sizeof(long));
+
+	/* a key is followed by a refresh as soon as the
+	 * echo arrives */
+	add_event(0, EV_OUTPUT, "$ ");
+	add_event(100000, EV_KEY, "a");
+	add_event(120000, EV_OUTPUT, "a");
+	add_event(1000000, EV_CLOSE, NULL);
+	run();
+	failed += expect_refreshes("key echo", echo, sizeof(echo)/sizeof(long));
+	if(strcmp(t.received, "a") != 0) {
+		printf("FAIL: child read '%s' instead of the key\n", t.received);
+		failed++;
+	}
+
+	/* an echo that arrives while output is still
+	 * settling isnt held back by the burst batching */
+	add_event(0, EV_OUTPUT, "$ ");
+	add_event(2000, EV_KEY, "a");
+	add_event(9000, EV_OUTPUT, "a");
+	add_event(1000000, EV_CLOSE, NULL);
+	run();
+	failed += expect_refreshes("echo after output", busy_echo, sizeof(busy_echo)/sizeof(long));
+
+	/* a key typed during a synchronized update isnt
+	 * drawn as a prediction until the update ends, 
+	 * which would put the half drawn frame in stdscr */
+	add_event(0, EV_OUTPUT, "$ ");
+	add_event(20000, EV_OUTPUT, "\033[?2026hhalf");
+	add_event(30000, EV_KEY, "a");
+	add_event(50000, EV_OUTPUT, "a\033[?2026l");
+	add_event(1000000, EV_CLOSE, NULL);
+	t.predict = PREDICT_ALWAYS;
+	run();
+	t.predict = PREDICT_NEVER;
+	failed += expect_refreshes("key during sync", sync_echo, sizeof(sync_echo)/sizeof(long));
+	if(t.drawn != 0) {
+		printf("FAIL: %d predictions drawn during a synchronized update\n", t.drawn);
+		failed++;
+	}
+
+	loop_free();
+	return (failed == 0)? 0 : 1;
+}
@@ -8,6 +8,25 @@ void print_conf(struct ncte_conf *c) {
 	printf("ncterm: \t\t'%s'\n", c->ncterm);
 	printf("term: \t\t\t'%s'\n", c->term);
 	printf("debug_file: \t\t'%s'\n", c->debug_file);
+	printf("metrics_socket: \t'%s'\n", c->metrics_socket);
+	printf("log_level: \t\t'%s'\n", c->log_level);
+	printf("palette: \t\t'%s'\n", c->palette);
+	printf("predict: \t\t'%s'\n", c->predict);
+	printf("render_threads: \t'%s'\n", c->render_threads);
+	printf("max_bps: \t\t'%s'\n", c->max_bps);
+	printf("profile_file: \t\t'%s'\n", c->profile_file);
+	printf("triggers: \t\t[");
+	for(i = 0; i < c->ntriggers; i++) {
+		printf("'%s'", c->triggers[i]);
+		if(i < c->ntriggers - 1)
+			printf(", ");
+	}
+	printf("]\n");
+	printf("trigger_file: \t\t'%s'\n", c->trigger_file);
+	printf("trigger_action: \t'%s'\n", c->trigger_action);
+	printf("snapshot_file: \t\t'%s'\n", c->snapshot_file);
+	printf("restore_file: \t\t'%s'\n", c->restore_file);
+	printf("io: \t\t\t'%s'\n", c->io);
 	printf("cmd: \t\t\t[");
 	for(i = 0; i < c->cmd_argc; i++) {
 		printf("'%s'", c->cmd_argv[i]);
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "vterm.h"
+#include "snapshot.h"
+#include "timer.h"
+#include "err.h"
+
+/* saves a screen with snapshot_open and snapshot_tick,
+ * restores it onto fresh vterms and compares them cell
+ * by cell.
+ */
+
+#define ROWS 5
+#define COLS 40
+
+static const VTermColor DEFAULT = {1, 1, 1}; /* what screen.c uses */
+
+static struct {
+	long now; /* usec of virtual time */
+	char path[64];
+	char tmp_path[70];
+} t;
+
+static int virtual_clock(struct timeval *now) {
+	now->tv_sec = 1000000 + t.now/1000000;
+	now->tv_usec = t.now%1000000;
+	return 0;
+}
+
+static VTerm *new_vt(int rows, int cols) {
+	VTerm *vt;
+
+	vt = vterm_new(rows, cols);
+	vterm_parser_set_utf8(vt, 1);
+	vterm_state_set_default_colors(vterm_obtain_state(vt), (VTermColor *) &DEFAULT, (VTermColor *) &DEFAULT);
+	vterm_screen_reset(vterm_obtain_screen(vt), 1);
+	return vt;
+}
+
+static void push(VTerm *vt, const char *s) {
+	vterm_push_bytes(vt, s, strlen(s));
+}
+
+static VTermScreenCell get(VTerm *vt, int row, int col) {
+	VTermPos pos = {.row = row, .col = col};
+	VTermScreenCell cell;
+
+	memset(&cell, 0, sizeof(cell));
+	vterm_screen_get_cell(vterm_obtain_screen(vt), pos, &cell);
+	return cell;
+}
+
+/* restore draws a blank as a space */
+static uint32_t text(const VTermScreenCell *cell, int i) {
+	return (i == 0 && cell->chars[0] == ' ')? 0 : cell->chars[i];
+}
+
+static int same_cell(const VTermScreenCell *a, const VTermScreenCell *b) {
+	int i;
+
+	for(i = 0; i < VTERM_MAX_CHARS_PER_CELL; i++) {
+		if(text(a, i) != text(b, i) )
+			return 0;
+		if(a->chars[i] == 0 || a->chars[i] == (uint32_t) -1)
+			break;
+	}
+
+	return a->width == b->width
+		&& a->attrs.bold == b->attrs.bold
+		&& a->attrs.underline == b->attrs.underline
+		&& a->attrs.italic == b->attrs.italic
+		&& a->attrs.reverse == b->attrs.reverse
+		&& a->attrs.strike == b->attrs.strike
+		&& memcmp(&a->fg, &b->fg, sizeof(VTermColor)) == 0
+		&& memcmp(&a->bg, &b->bg, sizeof(VTermColor)) == 0;
+}
+
+/* compares the top left rows x cols of both screens
+ * and the cursor, clipped to them */
+static int same_screen(VTerm *want, VTerm *got, int rows, int cols) {
+	VTermScreenCell a, b;
+	VTermPos want_pos, got_pos;
+	int row, col;
+
+	for(row = 0; row < rows; row++) {
+		for(col = 0; col < cols; col++) {
+			a = get(want, row, col);
+			b = get(got, row, col);
+			if(!same_cell(&a, &b) ) {
+				printf("\tcell %d,%d: want U+%04x got U+%04x\n", row, col,
+					(unsigned int) a.chars[0], (unsigned int) b.chars[0]);
+				return 0;
+			}
+		}
+	}
+
+	vterm_state_get_cursorpos(vterm_obtain_state(want), &want_pos);
+	vterm_state_get_cursorpos(vterm_obtain_state(got), &got_pos);
+	if(want_pos.row >= rows)
+		want_pos.row = rows - 1;
+	if(want_pos.col >= cols)
+		want_pos.col = cols - 1;
+	if(want_pos.row != got_pos.row || want_pos.col != got_pos.col) {
+		printf("\tcursor: want %d,%d got %d,%d\n", want_pos.row, want_pos.col, got_pos.row, got_pos.col);
+		return 0;
+	}
+
+	return 1;
+}
+
+static int check(const char *name, int ok) {
+	printf("%s: %s\n", ok? "ok" : "FAIL", name);
+	return !ok;
+}
+
+static void append(const unsigned char *data, size_t len) {
+	FILE *fp;
+
+	if( (fp = fopen(t.path, "ab")) == NULL || fwrite(data, 1, len, fp) != len || fclose(fp) != 0)
+		err_exit(errno, "append to %s", t.path);
+}
+
+static void overwrite(const unsigned char *data, size_t len) {
+	if(truncate(t.path, 0) != 0)
+		err_exit(errno, "truncate %s", t.path);
+	append(data, len);
+}
+
+static int restored(VTerm *want, int rows, int cols) {
+	VTerm *vt;
+	int ok;
+
+	vt = new_vt(rows, cols);
+	ok = (snapshot_restore(t.path, vt) == 0 && same_screen(want, vt, rows, cols) );
+	vterm_free(vt);
+	return ok;
+}
+
+int main() {
+	/* a row record for row 0 cut off inside its cell */
+	static const unsigned char cut_row[] = {'R', 0, 0, 1, 0, COLS, 0, 1, 'X', 0};
+	static const unsigned char huge[] = {'N', 'C', 'T', 'E', 'S', 'N', 'P', '1',
+		'S', 0xff, 0xff, 0xff, 0xff, 'C', 0, 0, 0, 0};
+	VTerm *vt, *blank;
+	struct stat st;
+	int fd, failed;
+
+	strcpy(t.path, "/tmp/ncte_snapshot_test.XXXXXX");
+	if( (fd = mkstemp(t.path)) < 0)
+		err_exit(errno, "mkstemp");
+	close(fd);
+	sprintf(t.tmp_path, "%s.tmp", t.path);
+	timer_set_clock(virtual_clock);
+	failed = 0;
+
+	/* a blank screen is a few runs per row */
+	blank = new_vt(24, 80);
+	if(snapshot_open(t.path, blank) != 0)
+		err_exit(errno, "snapshot_open");
+	snapshot_close();
+	failed += check("rle", stat(t.path, &st) == 0 && st.st_size < 24*80);
+	vterm_free(blank);
+
+	vt = new_vt(ROWS, COLS);
+	push(vt, "plain text");
+	push(vt, "\033[2;1H\033[1;31mbold red\033[0m \033[4;44munderlined on blue\033[0m");
+	push(vt, "\033[3;1H\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e wide");
+	push(vt, "\033[4;3H\033[7;38;2;10;20;30m==============================\033[0m");
+	push(vt, "\033[5;7H");
+	if(snapshot_open(t.path, vt) != 0)
+		err_exit(errno, "snapshot_open");
+
+	/* changes after the full snapshot are appended */
+	push(vt, "\033[5;1Hlater");
+	snapshot_mark(4, 5);
+	t.now += 2000000;
+	snapshot_tick();
+	snapshot_close();
+
+	failed += check("round trip", restored(vt, ROWS, COLS) );
+
+	/* a record cut off by a crash is ignored */
+	append(cut_row, sizeof(cut_row) );
+	failed += check("truncated tail", restored(vt, ROWS, COLS) );
+
+	/* a smaller terminal gets the top left corner */
+	failed += check("clipped", restored(vt, 3, 10) );
+
+	/* a corrupt size is rejected before allocating */
+	blank = new_vt(ROWS, COLS);
+	overwrite(huge, sizeof(huge) );
+	failed += check("corrupt size", restored(blank, ROWS, COLS) );
+	vterm_free(blank);
+
+	vterm_free(vt);
+	unlink(t.path);
+	unlink(t.tmp_path);
+	return (failed == 0)? 0 : 1;
+}
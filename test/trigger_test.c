@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+#include "trigger.h"
+#include "err.h"
+
+/* builds trigger sets and checks how many matches
+ * trigger_scan reports for each read.
+ */
+
+static void build(const char *const patterns[]) {
+	int i;
+
+	trigger_free();
+	for(i = 0; patterns[i] != NULL; i++)
+		if(trigger_add(patterns[i]) != 0)
+			err_exit(errno, "trigger_add");
+	if(trigger_build(TRIGGER_LOG) != 0)
+		err_exit(errno, "trigger_build");
+}
+
+static int scan(const char *buf) {
+	return trigger_scan(buf, strlen(buf));
+}
+
+static int expect(const char *name, int got, int want) {
+	printf("%s: %s\n", (got == want)? "ok" : "FAIL", name);
+	if(got != want)
+		printf("\tgot %d matches, expected %d\n", got, want);
+
+	return got != want;
+}
+
+int main() {
+	static const char *const overlapping[] = {"he", "she", "hers", NULL};
+	static const char *const single[] = {"error", NULL};
+	char report[256];
+	FILE *fp;
+	size_t n;
+	int failed;
+
+	failed = 0;
+
+	/* one read ending in she, he and hers */
+	build(overlapping);
+	failed += expect("overlapping", scan("ushers"), 3);
+	failed += expect("no match", scan("xyz"), 0);
+	failed += expect("repeated", scan("hehe"), 2);
+
+	/* the report counts each pattern separately */
+	if( (fp = tmpfile()) == NULL)
+		err_exit(errno, "tmpfile");
+	trigger_report(fp);
+	rewind(fp);
+	n = fread(report, 1, sizeof(report) - 1, fp);
+	report[n] = '\0';
+	fclose(fp);
+	failed += expect("report", strcmp(report,
+		"trigger 0 'he': 3 matches\n"
+		"trigger 1 'she': 1 matches\n"
+		"trigger 2 'hers': 1 matches\n"), 0);
+
+	/* the state carries over between reads */
+	build(overlapping);
+	failed += expect("split head", scan("us"), 0);
+	failed += expect("split middle", scan("h"), 0);
+	failed += expect("split tail", scan("ers"), 3);
+
+	/* one possible first byte goes through memchr */
+	build(single);
+	failed += expect("single", scan("no errors here, an error there"), 2);
+	failed += expect("single restart", scan("eerror, errerror"), 2);
+	failed += expect("single split head", scan("an err"), 0);
+	failed += expect("single split tail", scan("or"), 1);
+	failed += expect("single broken", scan("err"), 0);
+	failed += expect("single broken tail", scan("xor"), 0);
+
+	trigger_free();
+	return (failed == 0)? 0 : 1;
+}
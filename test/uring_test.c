@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/select.h>
+#include <sys/time.h>
+
+#include "uring.h"
+#include "err.h"
+
+/* drives uring_wait and uring_read on pipes standing
+ * in for the master pty and another input fd. skips
+ * if the kernel wont give us a ring.
+ */
+
+#define CHUNK 16 /* size of the registered buffer */
+
+static struct {
+	int master[2];
+	int other[2];
+} t;
+
+static int wait_for(int want_master, int want_other, long usec, fd_set *in) {
+	struct timeval timeout = {usec/1000000, usec%1000000};
+	fd_set out;
+	int nfds;
+
+	FD_ZERO(in);
+	FD_ZERO(&out);
+	if(want_master)
+		FD_SET(t.master[0], in);
+	if(want_other)
+		FD_SET(t.other[0], in);
+	nfds = ( (t.master[0] > t.other[0])? t.master[0] : t.other[0]) + 1;
+
+	return uring_wait(nfds, in, &out, &timeout);
+}
+
+static void put(int fd, const char *data) {
+	if(write(fd, data, strlen(data)) != (ssize_t) strlen(data))
+		err_exit(errno, "write");
+}
+
+static void on_alarm(int signo) {
+	(void)(signo);
+}
+
+static int check(const char *name, int ok) {
+	printf("%s: %s\n", ok? "ok" : "FAIL", name);
+	return !ok;
+}
+
+int main() {
+	struct sigaction alarm_act;
+	struct itimerval alarm_at = {{0, 0}, {0, 50000}};
+	char buf[64];
+	fd_set in;
+	ssize_t n;
+	int failed, saved_errno;
+
+	if(pipe(t.master) != 0 || pipe(t.other) != 0)
+		err_exit(errno, "pipe");
+	if(fcntl(t.master[0], F_SETFL, O_NONBLOCK) != 0 || fcntl(t.other[0], F_SETFL, O_NONBLOCK) != 0)
+		err_exit(errno, "fcntl");
+
+	if(uring_init(t.master[0], CHUNK) != 0) {
+		printf("skip: io_uring unavailable: %s\n", strerror(errno));
+		return 0;
+	}
+	failed = 0;
+
+	/* output on the master is read through the ring */
+	put(t.master[1], "hello");
+	n = wait_for(1, 1, 1000000, &in);
+	failed += check("master ready", n == 1 && FD_ISSET(t.master[0], &in) && !FD_ISSET(t.other[0], &in) );
+	n = uring_read(t.master[0], buf, sizeof(buf));
+	failed += check("read", n == 5 && memcmp(buf, "hello", 5) == 0);
+
+	/* nothing to read */
+	n = wait_for(1, 1, 20000, &in);
+	failed += check("timeout", n == 0 && !FD_ISSET(t.master[0], &in) && !FD_ISSET(t.other[0], &in) );
+
+	/* the other fd is polled alongside the pending read */
+	put(t.other[1], "k");
+	n = wait_for(1, 1, 1000000, &in);
+	failed += check("second fd", n == 1 && FD_ISSET(t.other[0], &in) && !FD_ISSET(t.master[0], &in) );
+	if(read(t.other[0], buf, sizeof(buf)) != 1)
+		err_exit(errno, "read");
+
+	/* a chunk bigger than the callers buffer is handed
+	 * out over several reads without losing any of it */
+	put(t.master[1], "0123456789");
+	n = wait_for(1, 0, 1000000, &in);
+	failed += check("chunk ready", n == 1 && FD_ISSET(t.master[0], &in) );
+	n = uring_read(t.master[0], buf, 4);
+	failed += check("chunk head", n == 4 && memcmp(buf, "0123", 4) == 0);
+	n = wait_for(1, 0, 0, &in);
+	failed += check("chunk still ready", n == 1 && FD_ISSET(t.master[0], &in) );
+	n = uring_read(t.master[0], buf, 4);
+	n += uring_read(t.master[0], buf + 4, 4);
+	failed += check("chunk tail", n == 6 && memcmp(buf, "456789", 6) == 0);
+	n = wait_for(1, 0, 20000, &in);
+	failed += check("chunk drained", n == 0);
+
+	/* a signal during the wait comes back as EINTR like 
+	 * select, even though the same wait submits sqes */
+	memset(&alarm_act, 0, sizeof(alarm_act));
+	alarm_act.sa_handler = on_alarm;
+	sigemptyset(&alarm_act.sa_mask);
+	if(sigaction(SIGALRM, &alarm_act, NULL) != 0 || setitimer(ITIMER_REAL, &alarm_at, NULL) != 0)
+		err_exit(errno, "setitimer");
+	n = wait_for(1, 1, 900000, &in);
+	saved_errno = errno;
+	failed += check("interrupted", n == -1 && saved_errno == EINTR);
+
+	uring_free();
+	return (failed == 0)? 0 : 1;
+}